@@ -0,0 +1,311 @@
+#include <Core/JobSystem.hpp>
+#include <Core/ParallelFor.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace Core;
+
+namespace {
+    constexpr uint sElementCount   = 1'000'000;
+    constexpr uint sGrainSize      = 1024;
+    constexpr uint sRepeatCount    = 15;
+    constexpr uint sDispatchJobs   = 100'000;
+    constexpr uint sLatencySamples = 200;
+    constexpr uint sFanJobs        = 1000;
+
+    constexpr JobScheduler sSchedulers[] = { JobScheduler::Global, JobScheduler::WorkStealing, JobScheduler::Deadline };
+
+    using Clock = std::chrono::high_resolution_clock;
+
+    const char * SchedulerName( JobScheduler scheduler ) {
+        switch ( scheduler ) {
+            case JobScheduler::Global:       return "Global";
+            case JobScheduler::WorkStealing: return "WorkStealing";
+            case JobScheduler::Deadline:     return "Deadline";
+        }
+        return "Unknown";
+    }
+
+    // Every number the benchmark produces, printed as it comes in and written out as JSON at the end
+    struct Result final {
+        std::string suite;
+        std::string name;
+        std::string scheduler;
+        uint        threads;
+        double      value;
+        std::string unit;
+    };
+    std::vector<Result> sResults;
+
+    void Report( const char * suite, const char * name, JobScheduler scheduler, uint threads, double value, const char * unit ) {
+        sResults.push_back( Result { suite, name, SchedulerName( scheduler ), threads, value, unit } );
+        printf( "[BENCH] %-9s %-24s %-12s threads=%2u %12.3f %s\n", suite, name, SchedulerName( scheduler ), threads, value, unit );
+    }
+
+    bool WriteJson( const char * path ) {
+        std::ofstream ofs( path );
+        if ( !ofs ) {
+            printf( "[ERROR] Failed to write %s\n", path );
+            return false;
+        }
+        ofs << "{\n  \"benchmark\": \"vak_bench_jobs\",\n  \"hardwareThreads\": " << std::thread::hardware_concurrency() << ",\n  \"results\": [";
+        for ( size_t i = 0; i < sResults.size(); ++i ) {
+            const Result & r = sResults[i];
+            ofs << ( i ? "," : "" ) << "\n    { \"suite\": \"" << r.suite << "\", \"name\": \"" << r.name << "\", \"scheduler\": \"" << r.scheduler
+                << "\", \"threads\": " << r.threads << ", \"value\": " << r.value << ", \"unit\": \"" << r.unit << "\" }";
+        }
+        ofs << "\n  ]\n}\n";
+        printf( "[INFO] Wrote %zu results to %s\n", sResults.size(), path );
+        return true;
+    }
+
+    template<typename Function> double MedianMilliseconds( Function && fn ) {
+        std::vector<double> samples;
+        samples.reserve( sRepeatCount );
+        for ( uint i = 0; i < sRepeatCount; ++i ) {
+            const auto start = Clock::now();
+            fn();
+            const auto end   = Clock::now();
+            samples.push_back( std::chrono::duration<double, std::milli>( end - start ).count() );
+        }
+        std::sort( samples.begin(), samples.end() );
+        return samples[samples.size() / 2];
+    }
+
+    double Percentile( std::vector<double> & samples, double percentile ) {
+        std::sort( samples.begin(), samples.end() );
+        return samples[std::min( static_cast<size_t>( samples.size() * percentile ), samples.size() - 1 )];
+    }
+
+    void Spin( uint microseconds ) {
+        const auto end = Clock::now() + std::chrono::microseconds( microseconds );
+        while ( Clock::now() < end ) {}
+    }
+
+    // Dispatches tiny jobs with a 48 byte capture and helps until all of them ran, returns millions of jobs per second
+    template<typename Wrap> double DispatchThroughput( Wrap && wrap ) {
+        std::atomic<uint> done = 0;
+        const double ms = MedianMilliseconds( [&] {
+            done.store( 0, std::memory_order_relaxed );
+            for ( uint i = 0; i < sDispatchJobs; ++i ) {
+                const ulong payload[5] = { i, i + 1, i + 2, i + 3, i + 4 };
+                JobSystem::Instance()->DispatchJob( wrap( [&done, payload] {
+                    if ( payload[0] + payload[4] != 0 || payload[1] == 1 )
+                        done.fetch_add( 1, std::memory_order_relaxed );
+                }));
+            }
+            while ( done.load( std::memory_order_relaxed ) != sDispatchJobs ) {
+                if ( !JobSystem::Instance()->RunPendingJob() )
+                    std::this_thread::yield();
+            }
+        });
+        return sDispatchJobs / ms / 1000.0;
+    }
+
+    // Empty jobs measure the scheduler alone, the 48 byte capture compares inline Job storage against std::function,
+    // whose small buffer the capture does not fit
+    void BenchDispatch( JobScheduler scheduler, uint threads ) {
+        JobSystem::Instance()->Init( scheduler, threads - 1 );
+
+        const double emptyMs = MedianMilliseconds( [&] {
+            for ( uint i = 0; i < sDispatchJobs; ++i )
+                JobSystem::Instance()->DispatchJob( [] {} );
+            JobSystem::Instance()->WaitAll();
+        });
+        Report( "dispatch", "empty", scheduler, threads, sDispatchJobs / emptyMs / 1000.0, "Mjobs/s" );
+
+        if ( scheduler == JobScheduler::WorkStealing ) {
+            Report( "dispatch", "capture48_job", scheduler, threads, DispatchThroughput( []( auto && fn ) { return fn; } ), "Mjobs/s" );
+            Report( "dispatch", "capture48_std_function", scheduler, threads, DispatchThroughput( []( auto && fn ) { return std::function<void()>( fn ); } ), "Mjobs/s" );
+        }
+        JobSystem::Instance()->Destroy();
+    }
+
+    // Both latencies start from idle workers, the pause between samples lets them go back to sleep.
+    // Dispatch to start is the time until a worker picks the job up, WaitAll wake-up the time from the last job returning
+    // until a parked WaitAll returns
+    void BenchLatency( JobScheduler scheduler, uint threads ) {
+        JobSystem::Instance()->Init( scheduler, threads - 1 );
+        JobSystem::Instance()->SetHelpWhileWaiting( false );
+
+        std::vector<double> startUs, wakeUs;
+        for ( uint i = 0; i < sLatencySamples; ++i ) {
+            std::this_thread::sleep_for( std::chrono::microseconds( 500 ) );
+
+            Clock::time_point started, finished;
+            const auto dispatched = Clock::now();
+            JobSystem::Instance()->DispatchJob( [&] {
+                started = Clock::now();
+                Spin( 20 );
+                finished = Clock::now();
+            });
+            JobSystem::Instance()->WaitAll();
+            const auto woken = Clock::now();
+
+            startUs.push_back( std::chrono::duration<double, std::micro>( started - dispatched ).count() );
+            wakeUs.push_back( std::chrono::duration<double, std::micro>( woken - finished ).count() );
+        }
+        JobSystem::Instance()->SetHelpWhileWaiting( true );
+        JobSystem::Instance()->Destroy();
+
+        Report( "latency", "dispatch_to_start_p50", scheduler, threads, Percentile( startUs, 0.5 ), "us" );
+        Report( "latency", "dispatch_to_start_p99", scheduler, threads, Percentile( startUs, 0.99 ), "us" );
+        Report( "latency", "waitall_wakeup_p50", scheduler, threads, Percentile( wakeUs, 0.5 ), "us" );
+        Report( "latency", "waitall_wakeup_p99", scheduler, threads, Percentile( wakeUs, 0.99 ), "us" );
+    }
+
+    // Fan-out: a root job spawns children parented to it and the caller waits on the root.
+    // Fan-in: independent jobs followed by one job depending on all of them, the caller waits on that last one
+    void BenchFan( JobScheduler scheduler, uint threads ) {
+        JobSystem::Instance()->Init( scheduler, threads - 1 );
+
+        const double outMs = MedianMilliseconds( [&] {
+            const JobHandle root = JobSystem::Instance()->DispatchJob( [] {
+                for ( uint i = 0; i < sFanJobs; ++i )
+                    JobSystem::Instance()->DispatchJob( [] { Spin( 1 ); }, { .parent = JobSystem::Instance()->CurrentJob() } );
+            });
+            JobSystem::Instance()->WaitFor( root );
+        });
+
+        std::vector<JobHandle> handles( sFanJobs );
+        const double inMs = MedianMilliseconds( [&] {
+            for ( uint i = 0; i < sFanJobs; ++i )
+                handles[i] = JobSystem::Instance()->DispatchJob( [] { Spin( 1 ); } );
+            const JobHandle join = JobSystem::Instance()->DispatchJob( [] {}, { .dependencies = handles } );
+            JobSystem::Instance()->WaitFor( join );
+        });
+        JobSystem::Instance()->Destroy();
+
+        Report( "fan", "fan_out_1000", scheduler, threads, outMs, "ms" );
+        Report( "fan", "fan_in_1000", scheduler, threads, inMs, "ms" );
+    }
+
+    // Same shape as mesh loading, a root job fans out into heavy children and the calling thread waits on the root
+    void BenchWaitHelping( uint threads ) {
+        std::vector<float> scratch( threads * 64 * 16 );
+        for ( uint help = 0; help < 2; ++help ) {
+            JobSystem::Instance()->Init( JobScheduler::WorkStealing, threads - 1 );
+            JobSystem::Instance()->SetHelpWhileWaiting( help == 1 );
+            const double ms = MedianMilliseconds( [&] {
+                const JobHandle root = JobSystem::Instance()->DispatchJob( [&] {
+                    for ( uint i = 0; i < 64; ++i ) {
+                        JobSystem::Instance()->DispatchJob( [&, i] {
+                            float acc = 0.0f;
+                            for ( uint k = 0; k < 200'000; ++k )
+                                acc += std::sqrt( static_cast<float>( k + i ) );
+                            scratch[i * 16] = acc;
+                        }, { .parent = JobSystem::Instance()->CurrentJob() });
+                    }
+                });
+                JobSystem::Instance()->WaitFor( root );
+            });
+            JobSystem::Instance()->Destroy();
+            Report( "wait", help ? "load_like_helping" : "load_like_parked", JobScheduler::WorkStealing, threads, ms, "ms" );
+        }
+    }
+
+    // Streaming next to rendering: a backlog of Low jobs is queued up front, then every frame dispatches a batch of High jobs
+    // and waits for them. Reports the average time to finish a frame's batch and how much of the backlog got through meanwhile
+    void BenchFrameDeadline( JobScheduler scheduler, uint threads ) {
+        constexpr uint sFrames = 60, sFrameJobs = 32, sStreamJobs = 4000;
+
+        JobSystem::Instance()->Init( scheduler, threads - 1 );
+        std::atomic<uint> streamed = 0;
+        for ( uint i = 0; i < sStreamJobs; ++i ) {
+            JobSystem::Instance()->DispatchJob( [&streamed] {
+                Spin( 100 );
+                streamed.fetch_add( 1, std::memory_order_relaxed );
+            }, JobPriority::Low );
+        }
+
+        double totalMs = 0.0, worstMs = 0.0;
+        for ( uint frame = 0; frame < sFrames; ++frame ) {
+            JobSystem::Instance()->BeginFrame( 8.0f );
+            const auto start = Clock::now();
+            const JobHandle root = JobSystem::Instance()->DispatchJob( [] {}, { .deadline = JobSystem::Instance()->FrameDeadline() } );
+            for ( uint i = 0; i < sFrameJobs; ++i )
+                JobSystem::Instance()->DispatchJob( [] { Spin( 50 ); }, { .parent = root, .deadline = JobSystem::Instance()->FrameDeadline() } );
+            JobSystem::Instance()->WaitFor( root );
+
+            const double ms = std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+            totalMs += ms;
+            worstMs  = std::max( worstMs, ms );
+        }
+        const uint streamedDuringFrames = streamed.load( std::memory_order_relaxed );
+        JobSystem::Instance()->WaitAll();
+        JobSystem::Instance()->Destroy();
+
+        Report( "frame", "frame_batch_avg", scheduler, threads, totalMs / sFrames, "ms" );
+        Report( "frame", "frame_batch_worst", scheduler, threads, worstMs, "ms" );
+        Report( "frame", "streamed_during_frames", scheduler, threads, streamedDuringFrames, "jobs" );
+    }
+
+    // CPU bound ParallelFor and ParallelReduce over a 1M element workload, the calling thread counts as one of the threads
+    void BenchScaling( JobScheduler scheduler, uint maxThreads ) {
+        std::vector<float> input( sElementCount );
+        std::vector<float> output( sElementCount );
+        for ( uint i = 0; i < sElementCount; ++i )
+            input[i] = static_cast<float>( i ) * 0.001f;
+
+        double baseFor = 0.0, baseReduce = 0.0;
+        for ( uint threads = 1; threads <= maxThreads; ++threads ) {
+            JobSystem::Instance()->Init( scheduler, threads - 1 );
+
+            const double forMs = MedianMilliseconds( [&] {
+                ParallelFor( 0, sElementCount, sGrainSize, [&]( uint i ) {
+                    output[i] = std::sqrt( input[i] ) * std::sin( input[i] );
+                });
+            });
+
+            double sum = 0.0;
+            const double reduceMs = MedianMilliseconds( [&] {
+                sum = ParallelReduce<double>( 0, sElementCount, sGrainSize, 0.0,
+                    [&]( uint i ) { return static_cast<double>( std::sqrt( input[i] ) ); },
+                    []( double a, double b ) { return a + b; } );
+            });
+
+            JobSystem::Instance()->Destroy();
+
+            if ( threads == 1 ) {
+                baseFor    = forMs;
+                baseReduce = reduceMs;
+            }
+            Report( "scaling", "parallel_for", scheduler, threads, forMs, "ms" );
+            Report( "scaling", "parallel_for_speedup", scheduler, threads, baseFor / forMs, "x" );
+            Report( "scaling", "parallel_reduce", scheduler, threads, reduceMs, "ms" );
+            Report( "scaling", "parallel_reduce_speedup", scheduler, threads, baseReduce / reduceMs, "x" );
+        }
+    }
+}
+
+// Runs every suite for every scheduler and writes the results to the JSON file given as the first argument (bench_jobs.json by default).
+// Throughput, fan-out/in and waiting are measured at 1 and N threads, latencies need at least one worker besides the calling thread
+int main( int argc, char ** argv ) {
+    const uint maxThreads = std::max( std::thread::hardware_concurrency(), 1u );
+    const char * output = argc > 1 ? argv[1] : "bench_jobs.json";
+
+    for ( JobScheduler scheduler : sSchedulers ) {
+        BenchDispatch( scheduler, 1 );
+        BenchFan( scheduler, 1 );
+        if ( maxThreads > 1 ) {
+            BenchDispatch( scheduler, maxThreads );
+            BenchFan( scheduler, maxThreads );
+        }
+        BenchLatency( scheduler, std::max( maxThreads, 2u ) );
+        BenchScaling( scheduler, maxThreads );
+    }
+    if ( maxThreads > 1 ) {
+        BenchWaitHelping( maxThreads );
+        BenchFrameDeadline( JobScheduler::WorkStealing, maxThreads );
+        BenchFrameDeadline( JobScheduler::Deadline, maxThreads );
+    }
+
+    return WriteJson( output ) ? 0 : 1;
+}
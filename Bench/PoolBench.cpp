@@ -0,0 +1,321 @@
+#include <Util/Pool.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    constexpr uint sOpsPerThread = 200'000;
+    constexpr uint sLiveHandles  = 64; // Per thread, keeps the pool churning without growing forever
+    constexpr uint sEntryCount   = 1u << 16;
+    constexpr uint sRepeatCount  = 9;
+
+    constexpr uint sOccupancyPercents[] = { 10, 50, 90 };
+
+    using Clock = std::chrono::high_resolution_clock;
+
+    struct Hot final {
+        ulong key = 0;
+    };
+    struct Cold final {
+        ulong check = 0;
+    };
+    // Stands in for metadata like debug names or allocation info, which hot loops should never have to pull in
+    struct Wide final {
+        ulong payload[8] = {};
+    };
+    using TestPool   = Util::Pool<struct _Test, Hot, Cold>;
+    using WidePool   = Util::Pool<struct _Test, Hot, Cold, Wide>;
+    using TestHandle = Util::Handle<struct _Test>;
+
+    // Keeps the optimizer from dropping the loops being measured
+    volatile ulong sSink = 0;
+
+    // Every number the benchmark produces, printed as it comes in and written out as JSON at the end
+    struct Result final {
+        std::string suite;
+        std::string name;
+        std::string mode;
+        uint        param;
+        double      value;
+        std::string unit;
+    };
+    std::vector<Result> sResults;
+
+    const char * ModeName( Util::PoolMode mode ) {
+        return mode == Util::PoolMode::Concurrent ? "Concurrent" : "SingleThreaded";
+    }
+
+    void Report( const char * suite, const char * name, Util::PoolMode mode, uint param, double value, const char * unit ) {
+        sResults.push_back( Result { suite, name, ModeName( mode ), param, value, unit } );
+        printf( "[BENCH] %-10s %-18s %-14s param=%3u %12.3f %s\n", suite, name, ModeName( mode ), param, value, unit );
+    }
+
+    bool WriteJson( const char * path ) {
+        std::ofstream ofs( path );
+        if ( !ofs ) {
+            printf( "[ERROR] Failed to write %s\n", path );
+            return false;
+        }
+        ofs << "{\n  \"benchmark\": \"vak_bench_pool\",\n  \"hardwareThreads\": " << std::thread::hardware_concurrency() << ",\n  \"results\": [";
+        for ( size_t i = 0; i < sResults.size(); ++i ) {
+            const Result & r = sResults[i];
+            ofs << ( i ? "," : "" ) << "\n    { \"suite\": \"" << r.suite << "\", \"name\": \"" << r.name << "\", \"mode\": \"" << r.mode
+                << "\", \"param\": " << r.param << ", \"value\": " << r.value << ", \"unit\": \"" << r.unit << "\" }";
+        }
+        ofs << "\n  ]\n}\n";
+        printf( "[INFO] Wrote %zu results to %s\n", sResults.size(), path );
+        return true;
+    }
+
+    template<typename Function> double Milliseconds( Function && fn ) {
+        const auto start = Clock::now();
+        fn();
+        return std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+    }
+
+    // Setup runs before every sample and is not timed
+    template<typename Setup, typename Function> double MedianMilliseconds( Setup && setup, Function && fn ) {
+        std::vector<double> samples;
+        samples.reserve( sRepeatCount );
+        for ( uint i = 0; i < sRepeatCount; ++i ) {
+            setup();
+            samples.push_back( Milliseconds( fn ) );
+        }
+        std::sort( samples.begin(), samples.end() );
+        return samples[samples.size() / 2];
+    }
+
+    double NsPerOp( double ms, uint count ) { return ms * 1e6 / count; }
+
+    // Fills the pool with sEntryCount entries, returns their handles
+    template<typename Pool, typename... Extra> std::vector<TestHandle> Fill( Pool & pool, Extra &&... extra ) {
+        std::vector<TestHandle> handles;
+        handles.reserve( sEntryCount );
+        for ( uint i = 0; i < sEntryCount; ++i )
+            handles.push_back( pool.Create( Hot { i }, Cold { ~static_cast<ulong>( i ) }, Extra( extra )... ) );
+        return handles;
+    }
+
+    // Create, Get and Delete of sEntryCount entries on one thread. Deletes go in random order so the free list ends up scattered,
+    // recreating into that list afterwards is the steady state of a pool with churn
+    void BenchOps( Util::PoolMode mode ) {
+        TestPool pool( 1024, "Ops", UINT32_MAX, mode );
+        std::vector<TestHandle> handles;
+        std::mt19937 rng( 42 );
+
+        const double createMs = MedianMilliseconds( [&] { pool.Clear(); }, [&] { handles = Fill( pool ); } );
+        const double getMs = MedianMilliseconds( [] {}, [&] {
+            ulong sum = 0;
+            for ( const TestHandle handle : handles )
+                sum += pool.Get( handle )->key;
+            sSink = sum;
+        });
+        const double deleteMs = MedianMilliseconds( [&] {
+            pool.Clear();
+            handles = Fill( pool );
+            std::shuffle( handles.begin(), handles.end(), rng );
+        }, [&] {
+            for ( const TestHandle handle : handles )
+                pool.Delete( handle );
+        });
+        const double recycleMs = MedianMilliseconds( [&] {
+            pool.Clear();
+            handles = Fill( pool );
+            std::shuffle( handles.begin(), handles.end(), rng );
+            for ( const TestHandle handle : handles )
+                pool.Delete( handle );
+            handles.clear();
+        }, [&] { handles = Fill( pool ); } );
+
+        Report( "ops", "create", mode, 0, NsPerOp( createMs, sEntryCount ), "ns/op" );
+        Report( "ops", "get", mode, 0, NsPerOp( getMs, sEntryCount ), "ns/op" );
+        Report( "ops", "delete_random", mode, 0, NsPerOp( deleteMs, sEntryCount ), "ns/op" );
+        Report( "ops", "create_recycled", mode, 0, NsPerOp( recycleMs, sEntryCount ), "ns/op" );
+    }
+
+    // Cost of checking a handle before using it, against a plain Get. Every other handle is stale, its slot was deleted and
+    // handed out again since
+    void BenchValidation( void ) {
+        TestPool pool( 1024, "Validation" );
+        std::vector<TestHandle> handles = Fill( pool );
+        for ( uint i = 0; i < sEntryCount; i += 2 )
+            pool.Delete( handles[i] );
+        for ( uint i = 0; i < sEntryCount; i += 2 )
+            std::ignore = pool.Create( Hot { i }, Cold {} );
+        std::shuffle( handles.begin(), handles.end(), std::mt19937( 7 ) );
+
+        std::vector<TestHandle> live;
+        std::copy_if( handles.begin(), handles.end(), std::back_inserter( live ), [&]( TestHandle handle ) { return pool.IsAlive( handle ); } );
+
+        const double getMs = MedianMilliseconds( [] {}, [&] {
+            ulong sum = 0;
+            for ( const TestHandle handle : live )
+                sum += pool.Get( handle )->key;
+            sSink = sum;
+        });
+        const double checkedGetMs = MedianMilliseconds( [] {}, [&] {
+            ulong sum = 0;
+            for ( const TestHandle handle : live ) {
+                if ( pool.IsAlive( handle ) )
+                    sum += pool.Get( handle )->key;
+            }
+            sSink = sum;
+        });
+        const double mixedMs = MedianMilliseconds( [] {}, [&] {
+            ulong sum = 0;
+            for ( const TestHandle handle : handles ) {
+                if ( pool.IsAlive( handle ) )
+                    sum += pool.Get( handle )->key;
+            }
+            sSink = sum;
+        });
+        Report( "validate", "get", Util::PoolMode::SingleThreaded, 100, NsPerOp( getMs, static_cast<uint>( live.size() ) ), "ns/op" );
+        Report( "validate", "is_alive_get", Util::PoolMode::SingleThreaded, 100, NsPerOp( checkedGetMs, static_cast<uint>( live.size() ) ), "ns/op" );
+        Report( "validate", "is_alive_get", Util::PoolMode::SingleThreaded, 50, NsPerOp( mixedMs, sEntryCount ), "ns/op" );
+    }
+
+    // Visits every live entry at the given occupancy: through the dense index with one column, through the dense index with
+    // every column, which shows what the structure of arrays layout saves, and by scanning all slots as before the dense index
+    void BenchIteration( uint occupancyPercent ) {
+        WidePool pool( 1024, "Iteration" );
+        std::vector<TestHandle> handles = Fill( pool, Wide {} );
+        std::shuffle( handles.begin(), handles.end(), std::mt19937( 3 ) );
+        const uint live = sEntryCount * occupancyPercent / 100;
+        for ( uint i = live; i < sEntryCount; ++i )
+            pool.Delete( handles[i] );
+
+        const double hotMs = MedianMilliseconds( [] {}, [&] {
+            ulong sum = 0;
+            pool.ForEach<Hot>( [&]( TestHandle, const Hot & hot ) { sum += hot.key; } );
+            sSink = sum;
+        });
+        const double allMs = MedianMilliseconds( [] {}, [&] {
+            ulong sum = 0;
+            pool.ForEach<Hot, Cold, Wide>( [&]( TestHandle, const Hot & hot, const Cold & cold, const Wide & wide ) {
+                sum += hot.key + cold.check + wide.payload[0];
+            });
+            sSink = sum;
+        });
+        const double scanMs = MedianMilliseconds( [] {}, [&] {
+            ulong sum = 0;
+            for ( uint i = 0; i < pool.GetObjectCount(); ++i ) {
+                const TestHandle handle = pool.GetHandle( i );
+                if ( pool.IsAlive( handle ) )
+                    sum += pool.Get( handle )->key;
+            }
+            sSink = sum;
+        });
+
+        Report( "iterate", "dense_hot", Util::PoolMode::SingleThreaded, occupancyPercent, NsPerOp( hotMs, live ), "ns/entry" );
+        Report( "iterate", "dense_all_columns", Util::PoolMode::SingleThreaded, occupancyPercent, NsPerOp( allMs, live ), "ns/entry" );
+        Report( "iterate", "slot_scan", Util::PoolMode::SingleThreaded, occupancyPercent, NsPerOp( scanMs, live ), "ns/entry" );
+    }
+
+    // Every thread creates and deletes its own handles with a key only it uses, so a slot handed out twice or a torn generation
+    // shows up as a foreign or mismatched key. Returns the number of bad reads
+    template<typename Create, typename Read, typename Delete> uint Churn( uint threads, Create && create, Read && read, Delete && del ) {
+        std::atomic<uint> errors = 0;
+        std::vector<std::thread> pool;
+        for ( uint t = 0; t < threads; ++t ) {
+            pool.emplace_back( [&, t] {
+                std::vector<TestHandle> live;
+                live.reserve( sLiveHandles );
+                for ( uint i = 0; i < sOpsPerThread; ++i ) {
+                    if ( live.size() < sLiveHandles && i % 3 != 0 ) {
+                        const ulong key = static_cast<ulong>( t ) << 40 | i;
+                        live.push_back( create( key ) );
+                        continue;
+                    }
+                    if ( live.empty() )
+                        continue;
+                    const TestHandle handle = live.back();
+                    live.pop_back();
+
+                    ulong key, check;
+                    read( handle, key, check );
+                    if ( key >> 40 != t || key != ~check )
+                        errors.fetch_add( 1, std::memory_order_relaxed );
+                    del( handle );
+                }
+                for ( const TestHandle & handle : live )
+                    del( handle );
+            });
+        }
+        for ( std::thread & thread : pool )
+            thread.join();
+        return errors.load();
+    }
+
+    // Stress tests the concurrent pool and compares it against a single threaded pool behind a mutex, returns false on a bad
+    // read or a leaked entry
+    bool BenchConcurrent( uint threads ) {
+        TestPool concurrent( 256, "Concurrent", UINT32_MAX, Util::PoolMode::Concurrent );
+        uint errors = 0;
+        const double concurrentMs = Milliseconds( [&] {
+            errors = Churn( threads,
+                [&]( ulong key ) { return concurrent.Create( Hot { key }, Cold { ~key } ); },
+                [&]( TestHandle handle, ulong & key, ulong & check ) {
+                    key   = concurrent.Get( handle )->key;
+                    check = concurrent.Get<Cold>( handle )->check;
+                },
+                [&]( TestHandle handle ) { concurrent.Delete( handle ); } );
+        });
+        const Util::PoolStats stats = concurrent.GetStats();
+        const bool leaked = stats.live != 0 || !concurrent.GetHandles().empty();
+
+        TestPool locked( 256, "Locked" );
+        std::mutex mutex;
+        const double mutexMs = Milliseconds( [&] {
+            Churn( threads,
+                [&]( ulong key ) {
+                    std::lock_guard<std::mutex> lock( mutex );
+                    return locked.Create( Hot { key }, Cold { ~key } );
+                },
+                [&]( TestHandle handle, ulong & key, ulong & check ) {
+                    std::lock_guard<std::mutex> lock( mutex );
+                    key   = locked.Get( handle )->key;
+                    check = locked.Get<Cold>( handle )->check;
+                },
+                [&]( TestHandle handle ) {
+                    std::lock_guard<std::mutex> lock( mutex );
+                    locked.Delete( handle );
+                } );
+        });
+
+        const double ops = static_cast<double>( threads ) * sOpsPerThread;
+        Report( "concurrent", "churn", Util::PoolMode::Concurrent, threads, ops / concurrentMs / 1000.0, "Mops/s" );
+        Report( "concurrent", "churn_mutex", Util::PoolMode::SingleThreaded, threads, ops / mutexMs / 1000.0, "Mops/s" );
+        Report( "concurrent", "high_water", Util::PoolMode::Concurrent, threads, stats.highWater, "entries" );
+        if ( errors != 0 || leaked )
+            printf( "[ERROR] Concurrent pool with %u threads: %u bad reads%s\n", threads, errors, leaked ? ", leaked entries" : "" );
+        return errors == 0 && !leaked;
+    }
+}
+
+// Single threaded Create/Get/Delete throughput, handle validation, iteration at several occupancy levels and a concurrent
+// stress test from 1 to 2N threads. Results go to argv[1] or bench_pool.json, the exit code reports stress test failures
+int main( int argc, char ** argv ) {
+    const uint maxThreads = std::max( std::thread::hardware_concurrency(), 1u ) * 2;
+    const char * output = argc > 1 ? argv[1] : "bench_pool.json";
+
+    BenchOps( Util::PoolMode::SingleThreaded );
+    BenchOps( Util::PoolMode::Concurrent );
+    BenchValidation();
+    for ( uint occupancy : sOccupancyPercents )
+        BenchIteration( occupancy );
+
+    bool passed = true;
+    for ( uint threads = 1; threads <= maxThreads; threads *= 2 )
+        passed &= BenchConcurrent( threads );
+
+    const bool written = WriteJson( output );
+    return written && passed ? 0 : 1;
+}
@@ -1,6 +1,13 @@
 #include <Core/WindowManager.hpp>
 
 int main( void ) {
+    // Fibers keep workers busy while texture jobs wait on their staging copies, one core stays with the main thread
+    Core::WindowManager::Instance()->SetJobSystemSpecification({
+        .backend       = Core::JobBackend::Fibers,
+        .ioWorkers     = 2,
+        .reservedCores = 1,
+        .pinWorkers    = true
+    });
     Core::WindowManager::Instance()->InitWindow();
     Core::WindowManager::Instance()->Run();
     return 0;
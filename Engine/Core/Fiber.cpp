@@ -0,0 +1,144 @@
+#include <Core/Fiber.hpp>
+
+#include <assert.h>
+
+#if defined( _WIN32 )
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstdint>
+#endif
+
+#if !defined( _WIN32 ) && defined( __x86_64__ )
+// Saves the callee-saved registers plus the SSE and x87 control words on the current stack, stores the stack pointer in *from
+// and unwinds the same frame from the to stack. A fresh fiber starts in FiberStart with the entry in r12 and its argument in r13
+extern "C" void VakFiberSwitch( void ** from, void * to );
+extern "C" void VakFiberStart( void );
+asm(R"(
+    .text
+    .globl VakFiberSwitch
+    .type VakFiberSwitch, @function
+VakFiberSwitch:
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    subq $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $8, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+    .size VakFiberSwitch, .-VakFiberSwitch
+
+    .globl VakFiberStart
+    .type VakFiberStart, @function
+VakFiberStart:
+    movq %r13, %rdi
+    callq *%r12
+    ud2
+    .size VakFiberStart, .-VakFiberStart
+)");
+#endif
+
+void Core::Fiber::InitFromThread( void ) {
+#if defined( _WIN32 )
+    mHandle     = ConvertThreadToFiber( nullptr );
+    mFromThread = true;
+    assert( mHandle );
+#endif
+    // The other backends fill in the context on the first switch away from the thread
+}
+
+void Core::Fiber::Init( Entry entry, void * arg, size_t stackSize ) {
+    mEntry = entry;
+    mArg   = arg;
+
+#if defined( _WIN32 )
+    // Only a few pages get committed up front, the rest of the stack is reserved
+    mHandle = CreateFiberEx( 64 * 1024, stackSize, FIBER_FLAG_FLOAT_SWITCH, &Fiber::Start, this );
+    assert( mHandle );
+#else
+    // Lowest page is left inaccessible so an overflow faults instead of corrupting the neighbouring stack
+    const size_t pageSize = static_cast<size_t>( sysconf( _SC_PAGESIZE ) );
+    mStackSize = ( stackSize + pageSize - 1 ) / pageSize * pageSize + pageSize;
+    mStack     = mmap( nullptr, mStackSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    assert( mStack != MAP_FAILED );
+    mprotect( mStack, pageSize, PROT_NONE );
+
+#if defined( __x86_64__ )
+    // Lay out the frame VakFiberSwitch unwinds, returning into VakFiberStart with a 16 byte aligned stack
+    const uintptr_t top = ( reinterpret_cast<uintptr_t>( mStack ) + mStackSize - 16 ) & ~static_cast<uintptr_t>( 15 );
+    void ** frame = reinterpret_cast<void **>( top ) - 8;
+    frame[0] = reinterpret_cast<void *>( static_cast<uintptr_t>( 0x037F ) << 32 | 0x1F80 ); // Default x87 and SSE control words
+    frame[1] = nullptr;                                                                       // r15
+    frame[2] = nullptr;                                                                       // r14
+    frame[3] = arg;                                                                           // r13
+    frame[4] = reinterpret_cast<void *>( entry );                                             // r12
+    frame[5] = nullptr;                                                                       // rbx
+    frame[6] = nullptr;                                                                       // rbp
+    frame[7] = reinterpret_cast<void *>( &VakFiberStart );                                    // Return address
+    mStackPointer = frame;
+#else
+    getcontext( &mContext );
+    mContext.uc_stack.ss_sp   = static_cast<_byte *>( mStack ) + pageSize;
+    mContext.uc_stack.ss_size = mStackSize - pageSize;
+    mContext.uc_link          = nullptr;
+    const uintptr_t self = reinterpret_cast<uintptr_t>( this );
+    makecontext( &mContext, reinterpret_cast<void (*)()>( &Fiber::Start ), 2, static_cast<uint>( self >> 32 ), static_cast<uint>( self ) );
+#endif
+#endif
+}
+
+void Core::Fiber::Destroy( void ) {
+#if defined( _WIN32 )
+    if ( mHandle ) {
+        if ( mFromThread )
+            ConvertFiberToThread();
+        else
+            DeleteFiber( mHandle );
+    }
+    mHandle     = nullptr;
+    mFromThread = false;
+#else
+    if ( mStack )
+        munmap( mStack, mStackSize );
+    mStack     = nullptr;
+    mStackSize = 0;
+#endif
+}
+
+void Core::Fiber::Switch( Fiber & from, Fiber & to ) {
+#if defined( _WIN32 )
+    ( void )from;
+    SwitchToFiber( to.mHandle );
+#elif defined( __x86_64__ )
+    VakFiberSwitch( &from.mStackPointer, to.mStackPointer );
+#else
+    swapcontext( &from.mContext, &to.mContext );
+#endif
+}
+
+#if defined( _WIN32 )
+void __stdcall Core::Fiber::Start( void * fiber ) {
+    Fiber * self = static_cast<Fiber *>( fiber );
+    self->mEntry( self->mArg );
+}
+#elif !defined( __x86_64__ )
+void Core::Fiber::Start( uint high, uint low ) {
+    Fiber * self = reinterpret_cast<Fiber *>( static_cast<uintptr_t>( high ) << 32 | low );
+    self->mEntry( self->mArg );
+}
+#endif
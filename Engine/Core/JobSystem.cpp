@@ -1,76 +1,1051 @@
 #include <Core/JobSystem.hpp>
 
-void Core::JobSystem::Init() {
-    const uint threads = std::thread::hardware_concurrency();
-    mThreadPool.reserve( threads );
+#include <assert.h>
+#include <cstdio>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <string>
 
-    for ( uint i = 0; i < threads; ++i ) {
-        mThreadPool.emplace_back( &Core::JobSystem::ThreadMainLoop, this );
+#if defined( _WIN32 )
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+    constexpr uint sInvalidWorker = UINT32_MAX;
+    constexpr uint sInvalidNode   = UINT32_MAX;
+
+    thread_local uint            sWorkerIndex = sInvalidWorker;
+    thread_local uint            sRandomState = 0;
+    thread_local Core::JobHandle sCurrentJob  = {};
+    thread_local uint            sHelpDepth   = 0;
+    thread_local void *          sFiberSlot   = nullptr; // FiberSlot of the running job when the backend uses fibers
+
+#if defined( VAK_JOB_PROFILING )
+    thread_local uint sProfileSlot  = sInvalidWorker;
+    thread_local uint sProfileDepth = 0; // Jobs nested on the thread's own stack, only the outermost one counts as busy time
+#endif
+
+    // xorshift32, only used to pick steal victims
+    uint NextRandom( void ) {
+        uint x = sRandomState ? sRandomState : static_cast<uint>( std::hash<std::thread::id>{}( std::this_thread::get_id() ) ) | 1u;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        return sRandomState = x;
+    }
+
+    void Lock( std::atomic_flag & flag ) {
+        while ( flag.test_and_set( std::memory_order_acquire ) )
+            flag.wait( true, std::memory_order_relaxed );
+    }
+
+    void Unlock( std::atomic_flag & flag ) {
+        flag.clear( std::memory_order_release );
+        flag.notify_one();
+    }
+
+    // Logical cores of every NUMA node, a single entry when the machine is not NUMA or it cannot be queried
+    std::vector<std::vector<uint>> NumaNodeCores( void ) {
+        std::vector<std::vector<uint>> nodes;
+#if defined( _WIN32 )
+        ULONG highest = 0;
+        if ( GetNumaHighestNodeNumber( &highest ) ) {
+            for ( ULONG node = 0; node <= highest; ++node ) {
+                ULONGLONG mask = 0;
+                if ( !GetNumaNodeProcessorMask( static_cast<UCHAR>( node ), &mask ) || !mask )
+                    continue;
+                std::vector<uint> & cores = nodes.emplace_back();
+                for ( uint core = 0; core < 64; ++core ) {
+                    if ( mask & ( 1ull << core ) )
+                        cores.push_back( core );
+                }
+            }
+        }
+#else
+        // cpulist holds ranges like "0-7,16-23"
+        for ( uint node = 0; ; ++node ) {
+            std::ifstream ifs( "/sys/devices/system/node/node" + std::to_string( node ) + "/cpulist" );
+            if ( !ifs )
+                break;
+            std::vector<uint> & cores = nodes.emplace_back();
+            std::string range;
+            while ( std::getline( ifs, range, ',' ) ) {
+                const size_t dash  = range.find( '-' );
+                const uint   first = static_cast<uint>( std::stoul( range ) );
+                const uint   last  = dash == std::string::npos ? first : static_cast<uint>( std::stoul( range.substr( dash + 1 ) ) );
+                for ( uint core = first; core <= last; ++core )
+                    cores.push_back( core );
+            }
+        }
+#endif
+        return nodes;
+    }
+
+    // Cores in the order compute workers get them, alternating between NUMA nodes when asked to
+    std::vector<uint> CoreOrder( uint coreCount, bool numaAware ) {
+        std::vector<std::vector<uint>> nodes;
+        if ( numaAware )
+            nodes = NumaNodeCores();
+
+        std::vector<uint> order;
+        if ( nodes.size() < 2 ) {
+            for ( uint core = 0; core < coreCount; ++core )
+                order.push_back( core );
+            return order;
+        }
+        for ( size_t i = 0; order.size() < coreCount; ++i ) {
+            bool any = false;
+            for ( const auto & cores : nodes ) {
+                if ( i < cores.size() ) {
+                    order.push_back( cores[i] );
+                    any = true;
+                }
+            }
+            if ( !any )
+                break;
+        }
+        return order;
+    }
+
+    void PinCurrentThread( uint core ) {
+#if defined( _WIN32 )
+        SetThreadAffinityMask( GetCurrentThread(), 1ull << core );
+#else
+        cpu_set_t set;
+        CPU_ZERO( &set );
+        CPU_SET( core, &set );
+        pthread_setaffinity_np( pthread_self(), sizeof( set ), &set );
+#endif
+    }
+}
+
+void Core::JobSystem::Init( JobScheduler scheduler, uint threads, JobBackend backend ) {
+    Init( JobSystemSpecification { .scheduler = scheduler, .backend = backend, .computeWorkers = threads } );
+}
+
+void Core::JobSystem::Init( const JobSystemSpecification & spec ) {
+    mScheduler = spec.scheduler;
+    mBackend   = spec.backend;
+
+    const uint coreCount = std::max( std::thread::hardware_concurrency(), 1u );
+    const uint reserved  = std::min( spec.reservedCores, coreCount - 1 );
+    const uint threads   = spec.computeWorkers == JobSystemSpecification::sAutoWorkers ? coreCount - reserved : spec.computeWorkers;
+
+    // Slot 0 belongs to the thread calling Init, workers take the remaining slots
+    mWorkerQueueCount = threads + 1;
+    mWorkerQueues     = std::make_unique<WorkerQueues[]>( mWorkerQueueCount );
+    sWorkerIndex      = 0;
+    sRandomState      = 0x9E3779B9u;
+
+    // Every arena starts out owning its own slice of the nodes, lowest indices on top of the stack
+    const uint arenaCount = mWorkerQueueCount + 1;
+    mJobNodes   = std::make_unique<JobNode[]>( arenaCount * sJobsPerWorker );
+    mNodeArenas = std::make_unique<NodeArena[]>( arenaCount );
+    for ( uint a = 0; a < arenaCount; ++a ) {
+        NodeArena & arena = mNodeArenas[a];
+        for ( uint i = 0; i < sJobsPerWorker; ++i ) {
+            const uint idx = a * sJobsPerWorker + i;
+            mJobNodes[idx].arena = a;
+            arena.freeNodes[sJobsPerWorker - 1 - i] = idx;
+        }
+        arena.freeCount = sJobsPerWorker;
+        arena.remoteFree.store( sInvalidNode, std::memory_order_relaxed );
     }
+
+#if defined( VAK_JOB_PROFILING )
+    mProfileCount = mWorkerQueueCount + spec.ioWorkers + 1;
+    mProfiles     = std::make_unique<WorkerProfile[]>( mProfileCount );
+    mProfileEpoch = std::chrono::steady_clock::now();
+    sProfileSlot  = 0;
+#endif
+
+    // Fibers are created by each worker once it starts, slot 0 is the calling thread and runs jobs on its own stack
+    if ( mBackend == JobBackend::Fibers )
+        mWorkerFibers = std::make_unique<WorkerFibers[]>( mWorkerQueueCount );
+
+    // The reserved cores are the lowest ones, the rest are handed out in order and wrap around if there are more workers than cores
+    mWorkerCores.clear();
+    if ( spec.pinWorkers ) {
+        std::vector<uint> cores = CoreOrder( coreCount, spec.numaAware );
+        std::erase_if( cores, [&]( uint core ) { return core < reserved; } );
+        if ( !cores.empty() ) {
+            mWorkerCores.resize( mWorkerQueueCount );
+            for ( uint i = 1; i < mWorkerQueueCount; ++i )
+                mWorkerCores[i] = cores[( i - 1 ) % cores.size()];
+        }
+    }
+
     mRunning = true;
+    mThreadPool.reserve( threads );
+    for ( uint i = 0; i < threads; ++i ) {
+        mThreadPool.emplace_back( &Core::JobSystem::ThreadMainLoop, this, i + 1 );
+    }
+    mIoThreadPool.reserve( spec.ioWorkers );
+    for ( uint i = 0; i < spec.ioWorkers; ++i ) {
+        mIoThreadPool.emplace_back( &Core::JobSystem::IoMainLoop, this, mWorkerQueueCount + i );
+    }
+    printf( "[INFO] Job system started with %u compute workers (%s) and %u I/O workers\n", threads, mWorkerCores.empty() ? "unpinned" : "pinned", spec.ioWorkers );
 }
 
 void Core::JobSystem::Destroy() {
-    mRunning = false;
+    {
+        std::lock_guard<std::mutex> lock( mJobQueueMutex );
+        mRunning = false;
+    }
     mWaitCondition.notify_all();
+    mWakeSignal.fetch_add( 1, std::memory_order_seq_cst );
+    mWakeSignal.notify_all();
+    {
+        std::lock_guard<std::mutex> lock( mIoQueueMutex );
+    }
+    mIoCondition.notify_all();
 
     for ( auto & thread : mThreadPool ) {
         if ( thread.joinable() )
             thread.join();
     }
+    mThreadPool.clear();
+    for ( auto & thread : mIoThreadPool ) {
+        if ( thread.joinable() )
+            thread.join();
+    }
+    mIoThreadPool.clear();
+    mIoQueue = {};
+    mWorkerFibers.reset();
+
+    mDeadlineQueue.clear();
+    mFrameStart.store( 0, std::memory_order_relaxed );
+    mFrameBudget.store( 0, std::memory_order_relaxed );
+
+    mPolls.clear();
+    mPollCount.store( 0, std::memory_order_relaxed );
+    mPolling.store( false, std::memory_order_relaxed );
 }
 
-void Core::JobSystem::DispatchJob( Job job, JobPriority priority ) {
-    std::lock_guard<std::mutex> lock( mJobQueueMutex );
-    switch ( priority ) {
-        case JobPriority::High:   mHighQueue.push( job );   break;
-        case JobPriority::Normal: mNormalQueue.push( job ); break;
-        case JobPriority::Low:    mLowQueue.push( job );    break;
-    }
+Core::JobHandle Core::JobSystem::DispatchJob( Job job, JobPriority priority ) {
+    return DispatchJob( std::move( job ), JobSpecification { .priority = priority } );
+}
+
+Core::JobHandle Core::JobSystem::DispatchJob( Job job, const JobSpecification & spec ) {
+    const uint idx = AllocateNode();
+    JobNode & node = mJobNodes[idx];
+
+    node.job      = std::move( job );
+    node.priority = spec.priority;
+    node.group    = spec.group;
+    if ( mScheduler == JobScheduler::Deadline )
+        node.deadline = spec.deadline ? spec.deadline : Now() + sAgingUs[PriorityIndex( spec.priority )];
+#if defined( VAK_JOB_PROFILING )
+    node.name     = spec.name;
+#endif
+    node.parent   = AddChild( spec.parent ) ? spec.parent : JobHandle {};
+    node.unfinished.store( 1, std::memory_order_relaxed );
+    node.dependencies.store( 1, std::memory_order_relaxed );
+
+    const JobHandle handle( idx, node.gen.load( std::memory_order_relaxed ) );
     mJobCounter.fetch_add( 1, std::memory_order_relaxed );
-    mWaitCondition.notify_one();
+
+    // Count a dependency before registering with it, otherwise it could complete and release us while we are still dispatching
+    for ( const JobHandle & dependency : spec.dependencies ) {
+        node.dependencies.fetch_add( 1, std::memory_order_relaxed );
+        if ( !AddContinuation( dependency, idx ) )
+            node.dependencies.fetch_sub( 1, std::memory_order_relaxed );
+    }
+    ResolveDependency( idx );
+    return handle;
+}
+
+void Core::JobSystem::DispatchWhen( bool ( *ready )( const void * ), const void * arg, Job job, JobPriority priority ) {
+    if ( ready( arg ) ) {
+        DispatchJob( std::move( job ), priority );
+        return;
+    }
+
+    Lock( mPollLock );
+    mPolls.push_back( PendingPoll { .ready = ready, .arg = arg, .job = std::move( job ), .priority = priority } );
+    mPollCount.fetch_add( 1, std::memory_order_release );
+    Unlock( mPollLock );
+
+    // Sleeping workers have to notice there is something to poll
+    if ( mScheduler == JobScheduler::Global && mBackend == JobBackend::Threads ) {
+        { std::lock_guard<std::mutex> lock( mJobQueueMutex ); }
+        mWaitCondition.notify_one();
+        return;
+    }
+    mWakeSignal.fetch_add( 1, std::memory_order_seq_cst );
+    if ( mSleepingWorkers.load( std::memory_order_seq_cst ) > 0 )
+        mWakeSignal.notify_one();
+}
+
+template<typename Done> void Core::JobSystem::HelpUntil( const Done & done ) {
+    if ( !mHelpWhileWaiting )
+        return;
+
+    // Run whatever is queued until the wait is satisfied. Once nothing is left to pick up, the caller blocks for real,
+    // whatever it waits on is then already running on other workers
+    for ( uint spin = 0; !done() && spin < sSpinCount; ++spin ) {
+        if ( RunPendingJob() )
+            spin = 0;
+        else
+            std::this_thread::yield();
+    }
+}
+
+void Core::JobSystem::WaitFor( JobHandle handle ) {
+    if ( !handle.Valid() )
+        return;
+    // Waiting on the running job from inside itself can never finish
+    assert( handle != sCurrentJob );
+
+    // The generation moves on once the job and all of its children are done and the node is recycled
+    std::atomic<uint> & gen = mJobNodes[handle.mIndex].gen;
+    HelpUntil( [&] { return gen.load( std::memory_order_acquire ) != handle.mGen; } );
+    if ( IsOnFiber() ) {
+        WaitUntil( [&] { return gen.load( std::memory_order_acquire ) != handle.mGen; } );
+        return;
+    }
+    while ( gen.load( std::memory_order_acquire ) == handle.mGen ) {
+        gen.wait( handle.mGen, std::memory_order_acquire );
+    }
 }
 
 void Core::JobSystem::WaitAll() {
-    while ( mJobCounter.load( std::memory_order_acquire ) != 0 ) {
-        mJobCounter.wait( mJobCounter.load() );
+    assert( !sCurrentJob.Valid() );
+
+    HelpUntil( [&] { return mJobCounter.load( std::memory_order_acquire ) == 0; } );
+    uint pending;
+    while ( ( pending = mJobCounter.load( std::memory_order_acquire ) ) != 0 ) {
+        mJobCounter.wait( pending );
+    }
+}
+
+bool Core::JobSystem::IsComplete( JobHandle handle ) const {
+    if ( !handle.Valid() )
+        return true;
+    const JobNode & node = mJobNodes[handle.mIndex];
+    return node.gen.load( std::memory_order_acquire ) != handle.mGen || node.unfinished.load( std::memory_order_acquire ) == 0;
+}
+
+ulong Core::JobSystem::Now( void ) {
+    return static_cast<ulong>( std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count() );
+}
+
+void Core::JobSystem::BeginFrame( float budgetMs ) {
+    mFrameBudget.store( static_cast<ulong>( budgetMs * 1000.0f ), std::memory_order_relaxed );
+    mFrameStart.store( Now(), std::memory_order_relaxed );
+}
+
+ulong Core::JobSystem::FrameDeadline( uint framesAhead ) const {
+    const ulong budget = mFrameBudget.load( std::memory_order_relaxed );
+    if ( budget == 0 )
+        return Now() + sAgingUs[PriorityIndex( JobPriority::Normal )];
+    return mFrameStart.load( std::memory_order_relaxed ) + budget * ( framesAhead + 1 );
+}
+
+bool Core::JobSystem::IsOnFiber( void ) const {
+    return sFiberSlot != nullptr;
+}
+
+Core::JobHandle Core::JobSystem::CurrentJob( void ) const {
+    return sCurrentJob;
+}
+
+uint Core::JobSystem::GetWorkerIndex( void ) const {
+    return sWorkerIndex < mWorkerQueueCount ? sWorkerIndex : sInvalidWorker;
+}
+
+bool Core::JobSystem::IsLocalQueueEmpty( void ) const {
+    if ( mScheduler != JobScheduler::WorkStealing || sWorkerIndex >= mWorkerQueueCount )
+        return true;
+    for ( const auto & queue : mWorkerQueues[sWorkerIndex].queues ) {
+        if ( !queue.Empty() )
+            return false;
     }
+    return true;
+}
+
+bool Core::JobSystem::RunPendingJob( void ) {
+    // Only threads owning a worker slot help out, anything else just waits
+    if ( sWorkerIndex >= mWorkerQueueCount || sHelpDepth >= sMaxHelpDepth )
+        return false;
+
+    JobNode * job = NextJob();
+    if ( !job )
+        return false;
+
+    ++sHelpDepth;
+    Execute( job );
+    --sHelpDepth;
+    return true;
 }
 
-void Core::JobSystem::ThreadMainLoop() {
-    auto pullJob = [this]() -> Job {
-        Job job = nullptr;
-        if ( !mHighQueue.empty() ) {
-            job = mHighQueue.front();
-            mHighQueue.pop();
-        } else if ( !mNormalQueue.empty() ) {
-            job = mNormalQueue.front();
-            mNormalQueue.pop();
-        } else if ( !mLowQueue.empty() ) {
-            job = mLowQueue.front();
-            mLowQueue.pop();
+void Core::JobSystem::ThreadMainLoop( uint workerIndex ) {
+    sWorkerIndex = workerIndex;
+    sRandomState = 0x9E3779B9u ^ ( workerIndex * 0x85EBCA6Bu );
+    if ( !mWorkerCores.empty() )
+        PinCurrentThread( mWorkerCores[workerIndex] );
+#if defined( VAK_JOB_PROFILING )
+    sProfileSlot = workerIndex;
+    mProfiles[workerIndex].startNs = ProfileNow();
+#endif
+
+    if ( mBackend == JobBackend::Fibers )
+        FiberMainLoop( workerIndex );
+    else if ( mScheduler == JobScheduler::Global )
+        GlobalMainLoop();
+    else
+        WorkStealingMainLoop();
+}
+
+void Core::JobSystem::IoMainLoop( uint profileSlot ) {
+#if defined( VAK_JOB_PROFILING )
+    sProfileSlot = profileSlot;
+    mProfiles[profileSlot].startNs = ProfileNow();
+#else
+    ( void )profileSlot;
+#endif
+    while ( true ) {
+        JobNode * job = nullptr;
+        {
+            std::unique_lock<std::mutex> lock( mIoQueueMutex );
+            mIoCondition.wait( lock, [&] { return !mRunning || !mIoQueue.empty(); } );
+
+            if ( !mRunning )
+                break;
+            job = mIoQueue.front();
+            mIoQueue.pop();
         }
-        return job;
-    };
+        Execute( job );
+    }
+}
 
+void Core::JobSystem::GlobalMainLoop( void ) {
     while ( true ) {
-        Job job = nullptr;
+        JobNode * job = nullptr;
         {
             std::unique_lock<std::mutex> lock( mJobQueueMutex );
-            mWaitCondition.wait( lock, [&] { return !mRunning || !mHighQueue.empty() || !mNormalQueue.empty() || !mLowQueue.empty(); } );
+            mWaitCondition.wait( lock, [&] {
+                return !mRunning || !mHighQueue.empty() || !mNormalQueue.empty() || !mLowQueue.empty() || mPollCount.load( std::memory_order_relaxed ) != 0;
+            });
 
             if ( !mRunning )
                 break;
-            job = pullJob();
+
+            if ( !mHighQueue.empty() ) {
+                job = mHighQueue.front();
+                mHighQueue.pop();
+            } else if ( !mNormalQueue.empty() ) {
+                job = mNormalQueue.front();
+                mNormalQueue.pop();
+            } else if ( !mLowQueue.empty() ) {
+                job = mLowQueue.front();
+                mLowQueue.pop();
+            }
+            if ( job )
+                mSharedJobCount.fetch_sub( 1, std::memory_order_relaxed );
+        }
+
+        // Woken up for pending polls only
+        if ( !job ) {
+            if ( !PollPending() )
+                std::this_thread::sleep_for( sPollInterval );
+            continue;
+        }
+        Execute( job );
+    }
+}
+
+void Core::JobSystem::WorkStealingMainLoop( void ) {
+    bool isPoller = false;
+    while ( mRunning.load( std::memory_order_relaxed ) ) {
+        JobNode * job = NextJob();
+        for ( uint spin = 0; !job && spin < sSpinCount; ++spin ) {
+            std::this_thread::yield();
+            job = NextJob();
         }
 
+        if ( !job ) {
+            // Sample the signal before the last look, so a dispatch racing with us changes it and the wait returns immediately
+            const uint signal = mWakeSignal.load( std::memory_order_seq_cst );
+            job = NextJob();
+            if ( !job ) {
+                if ( !mRunning.load( std::memory_order_relaxed ) )
+                    break;
+                if ( ClaimPolling( isPoller ) ) {
+                    std::this_thread::sleep_for( sPollInterval );
+                    continue;
+                }
+                mSleepingWorkers.fetch_add( 1, std::memory_order_seq_cst );
+                mWakeSignal.wait( signal, std::memory_order_seq_cst );
+                mSleepingWorkers.fetch_sub( 1, std::memory_order_seq_cst );
+                continue;
+            }
+        }
+        ReleasePolling( isPoller );
+        Execute( job );
+    }
+    ReleasePolling( isPoller );
+}
+
+void Core::JobSystem::FiberMainLoop( uint workerIndex ) {
+    WorkerFibers & fibers = mWorkerFibers[workerIndex];
+    fibers.scheduler.InitFromThread();
+    fibers.slots.reserve( sFibersPerWorker );
+    fibers.free.reserve( sFibersPerWorker );
+    fibers.parked.reserve( sFibersPerWorker );
+
+    const auto start = [&]( JobNode * job ) {
+        if ( fibers.free.empty() ) {
+            // Stacks are only reserved, pages get committed as a fiber actually touches them
+            FiberSlot * slot = fibers.slots.emplace_back( std::make_unique<FiberSlot>() ).get();
+            slot->worker = workerIndex;
+            slot->fiber.Init( &JobSystem::FiberMain, slot, sFiberStackSize );
+            fibers.free.push_back( slot );
+        }
+        FiberSlot * slot = fibers.free.back();
+        fibers.free.pop_back();
+        slot->job = job;
+        RunFiber( fibers, slot );
+    };
+
+    uint idle     = 0;
+    bool isPoller = false;
+    while ( mRunning.load( std::memory_order_relaxed ) ) {
+        // Parked fibers go first, they tend to hold on to something (a lock, a staging region) other jobs are after
+        FiberSlot * ready = nullptr;
+        for ( size_t i = 0; i < fibers.parked.size(); ++i ) {
+            if ( fibers.parked[i]->ready( fibers.parked[i]->readyArg ) ) {
+                ready = fibers.parked[i];
+                fibers.parked[i] = fibers.parked.back();
+                fibers.parked.pop_back();
+                break;
+            }
+        }
+        if ( ready ) {
+            ReleasePolling( isPoller );
+            RunFiber( fibers, ready );
+            idle = 0;
+            continue;
+        }
+
+        // There is no cap on the pool, a worker whose fibers are all parked still starts the job that may unpark them
+        JobNode * job = NextJob();
         if ( job ) {
-            job();
-            if ( mJobCounter.fetch_sub( 1, std::memory_order_acq_rel ) == 1 ) {
-                mJobCounter.notify_all();
+            ReleasePolling( isPoller );
+            start( job );
+            idle = 0;
+            continue;
+        }
+        if ( ++idle < sSpinCount ) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Nobody signals a parked fiber or a poll turning ready. A worker with parked fibers and the poller check again
+        // after a short sleep, the spinning above already caught whatever turns ready quickly
+        const bool polling = ClaimPolling( isPoller );
+        if ( polling || !fibers.parked.empty() ) {
+            std::this_thread::sleep_for( sPollInterval );
+            continue;
+        }
+        idle = 0;
+
+        const uint signal = mWakeSignal.load( std::memory_order_seq_cst );
+        if ( ( job = NextJob() ) ) {
+            start( job );
+            continue;
+        }
+        if ( !mRunning.load( std::memory_order_relaxed ) )
+            break;
+        mSleepingWorkers.fetch_add( 1, std::memory_order_seq_cst );
+        mWakeSignal.wait( signal, std::memory_order_seq_cst );
+        mSleepingWorkers.fetch_sub( 1, std::memory_order_seq_cst );
+    }
+
+    ReleasePolling( isPoller );
+    fibers.slots.clear();
+    fibers.scheduler.Destroy();
+}
+
+void Core::JobSystem::RunFiber( WorkerFibers & fibers, FiberSlot * slot ) {
+#if defined( VAK_JOB_PROFILING )
+    const ulong start = ProfileNow();
+#endif
+    sFiberSlot = slot;
+    Fiber::Switch( fibers.scheduler, slot->fiber );
+#if defined( VAK_JOB_PROFILING )
+    CurrentProfile().busyNs.fetch_add( ProfileNow() - start, std::memory_order_relaxed );
+#endif
+    sFiberSlot  = nullptr;
+    sCurrentJob = {};
+    sHelpDepth  = 0;
+
+    // The fiber either finished its job or parked in WaitUntil
+    if ( slot->job )
+        fibers.parked.push_back( slot );
+    else
+        fibers.free.push_back( slot );
+}
+
+void Core::JobSystem::FiberMain( void * arg ) {
+    FiberSlot * slot = static_cast<FiberSlot *>( arg );
+    JobSystem * js   = JobSystem::Instance();
+    while ( true ) {
+        js->Execute( slot->job );
+        slot->job = nullptr;
+        Fiber::Switch( slot->fiber, js->mWorkerFibers[slot->worker].scheduler );
+    }
+}
+
+void Core::JobSystem::Suspend( bool ( *ready )( const void * ), const void * readyArg ) {
+    FiberSlot * slot = static_cast<FiberSlot *>( sFiberSlot );
+    slot->ready    = ready;
+    slot->readyArg = readyArg;
+
+    // Thread locals belong to the worker rather than the fiber, other fibers change them while this one is parked
+    const JobHandle current = sCurrentJob;
+    const uint      depth   = sHelpDepth;
+    Fiber::Switch( slot->fiber, mWorkerFibers[slot->worker].scheduler );
+    sCurrentJob = current;
+    sHelpDepth  = depth;
+
+    slot->ready    = nullptr;
+    slot->readyArg = nullptr;
+}
+
+void Core::JobSystem::PushShared( JobNode * job ) {
+    std::lock_guard<std::mutex> lock( mJobQueueMutex );
+    switch ( job->priority ) {
+        case JobPriority::High:   mHighQueue.push( job );   break;
+        case JobPriority::Normal: mNormalQueue.push( job ); break;
+        case JobPriority::Low:    mLowQueue.push( job );    break;
+    }
+    mSharedJobCount.fetch_add( 1, std::memory_order_release );
+}
+
+Core::JobSystem::JobNode * Core::JobSystem::PullShared( uint priorityIndex ) {
+    if ( mSharedJobCount.load( std::memory_order_acquire ) == 0 )
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock( mJobQueueMutex );
+    std::queue<JobNode *> * queues[sPriorityCount] = { &mHighQueue, &mNormalQueue, &mLowQueue };
+    std::queue<JobNode *> & queue = *queues[priorityIndex];
+    if ( queue.empty() )
+        return nullptr;
+
+    JobNode * job = queue.front();
+    queue.pop();
+    mSharedJobCount.fetch_sub( 1, std::memory_order_relaxed );
+    return job;
+}
+
+void Core::JobSystem::PushDeadline( JobNode * job ) {
+    std::lock_guard<std::mutex> lock( mJobQueueMutex );
+    mDeadlineQueue.push_back( DeadlineEntry { .deadline = job->deadline, .sequence = mDeadlineSequence++, .job = job } );
+    std::push_heap( mDeadlineQueue.begin(), mDeadlineQueue.end(), std::greater<DeadlineEntry>() );
+    mSharedJobCount.fetch_add( 1, std::memory_order_release );
+}
+
+Core::JobSystem::JobNode * Core::JobSystem::PullDeadline( void ) {
+    if ( mSharedJobCount.load( std::memory_order_acquire ) == 0 )
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock( mJobQueueMutex );
+    if ( mDeadlineQueue.empty() )
+        return nullptr;
+
+    std::pop_heap( mDeadlineQueue.begin(), mDeadlineQueue.end(), std::greater<DeadlineEntry>() );
+    JobNode * job = mDeadlineQueue.back().job;
+    mDeadlineQueue.pop_back();
+    mSharedJobCount.fetch_sub( 1, std::memory_order_relaxed );
+    return job;
+}
+
+Core::JobSystem::JobNode * Core::JobSystem::FindJob( void ) {
+    // Workers only ever look at the head, so frame critical work takes over at the next job boundary
+    if ( mScheduler == JobScheduler::Deadline )
+        return PullDeadline();
+
+    const uint self = sWorkerIndex;
+    JobNode * job = nullptr;
+
+    // Exhaust a priority level everywhere (own deque, victims, shared queue) before looking at the next one
+    for ( uint p = 0; p < sPriorityCount; ++p ) {
+        if ( mScheduler == JobScheduler::WorkStealing ) {
+            if ( self < mWorkerQueueCount && mWorkerQueues[self].queues[p].Pop( job ) )
+                return job;
+
+            const uint start = NextRandom() % mWorkerQueueCount;
+            for ( uint i = 0; i < mWorkerQueueCount; ++i ) {
+                const uint victim = ( start + i ) % mWorkerQueueCount;
+                if ( victim == self )
+                    continue;
+#if defined( VAK_JOB_PROFILING )
+                WorkerProfile & profile = CurrentProfile();
+                profile.stealAttempts.fetch_add( 1, std::memory_order_relaxed );
+                if ( mWorkerQueues[victim].queues[p].Steal( job ) ) {
+                    profile.steals.fetch_add( 1, std::memory_order_relaxed );
+                    return job;
+                }
+#else
+                if ( mWorkerQueues[victim].queues[p].Steal( job ) )
+                    return job;
+#endif
+            }
+        }
+
+        if ( ( job = PullShared( p ) ) )
+            return job;
+    }
+    return nullptr;
+}
+
+Core::JobSystem::JobNode * Core::JobSystem::NextJob( void ) {
+    JobNode * job = FindJob();
+    if ( !job && PollPending() )
+        job = FindJob();
+    return job;
+}
+
+bool Core::JobSystem::PollPending( void ) {
+    if ( mPollCount.load( std::memory_order_acquire ) == 0 || mPollLock.test_and_set( std::memory_order_acquire ) )
+        return false;
+
+    bool dispatched = false;
+    for ( size_t i = 0; i < mPolls.size(); ) {
+        if ( !mPolls[i].ready( mPolls[i].arg ) ) {
+            ++i;
+            continue;
+        }
+        PendingPoll poll = std::move( mPolls[i] );
+        mPolls[i] = std::move( mPolls.back() );
+        mPolls.pop_back();
+        mPollCount.fetch_sub( 1, std::memory_order_relaxed );
+
+        DispatchJob( std::move( poll.job ), poll.priority );
+        dispatched = true;
+    }
+    Unlock( mPollLock );
+    return dispatched;
+}
+
+// Keeps the poller role while polls are pending, or takes it if nobody holds it
+bool Core::JobSystem::ClaimPolling( bool & isPoller ) {
+    if ( mPollCount.load( std::memory_order_acquire ) != 0 && ( isPoller || !mPolling.exchange( true, std::memory_order_seq_cst ) ) ) {
+        isPoller = true;
+        return true;
+    }
+    ReleasePolling( isPoller );
+    return false;
+}
+
+// A poller going back to work or to sleep wakes a parked worker to take over the polls that are still pending
+void Core::JobSystem::ReleasePolling( bool & isPoller ) {
+    if ( !isPoller )
+        return;
+    isPoller = false;
+    mPolling.store( false, std::memory_order_seq_cst );
+    if ( mPollCount.load( std::memory_order_seq_cst ) == 0 )
+        return;
+    mWakeSignal.fetch_add( 1, std::memory_order_seq_cst );
+    if ( mSleepingWorkers.load( std::memory_order_seq_cst ) > 0 )
+        mWakeSignal.notify_one();
+}
+
+void Core::JobSystem::Enqueue( JobNode * job ) {
+    if ( job->group == WorkerGroup::IO && !mIoThreadPool.empty() ) {
+        {
+            std::lock_guard<std::mutex> lock( mIoQueueMutex );
+            mIoQueue.push( job );
+        }
+        mIoCondition.notify_one();
+        return;
+    }
+
+    if ( mScheduler == JobScheduler::Global ) {
+        std::lock_guard<std::mutex> lock( mJobQueueMutex );
+        switch ( job->priority ) {
+            case JobPriority::High:   mHighQueue.push( job );   break;
+            case JobPriority::Normal: mNormalQueue.push( job ); break;
+            case JobPriority::Low:    mLowQueue.push( job );    break;
+        }
+        mSharedJobCount.fetch_add( 1, std::memory_order_release );
+        mWaitCondition.notify_one();
+
+        // Fiber workers park on the wake signal whatever the scheduler
+        if ( mBackend == JobBackend::Threads )
+            return;
+    } else if ( mScheduler == JobScheduler::Deadline ) {
+        PushDeadline( job );
+    } else {
+        const bool isWorker = sWorkerIndex < mWorkerQueueCount;
+        if ( !isWorker || !mWorkerQueues[sWorkerIndex].queues[PriorityIndex( job->priority )].Push( job ) )
+            PushShared( job );
+    }
+
+    mWakeSignal.fetch_add( 1, std::memory_order_seq_cst );
+    if ( mSleepingWorkers.load( std::memory_order_seq_cst ) > 0 )
+        mWakeSignal.notify_one();
+}
+
+void Core::JobSystem::Execute( JobNode * job ) {
+    const uint idx = static_cast<uint>( job - mJobNodes.get() );
+
+#if defined( VAK_JOB_PROFILING )
+    // Fiber workers count busy time around the switch into the fiber instead, a parked job is not keeping its worker busy
+    const bool  onFiber   = IsOnFiber();
+    const bool  outermost = !onFiber && sProfileDepth == 0;
+    const ulong start     = ProfileNow();
+    if ( !onFiber )
+        ++sProfileDepth;
+#endif
+
+    const JobHandle previous = std::exchange( sCurrentJob, JobHandle( idx, job->gen.load( std::memory_order_relaxed ) ) );
+    job->job();
+    job->job.Reset(); // Release captured state now rather than when the node gets reused
+    sCurrentJob = previous;
+
+#if defined( VAK_JOB_PROFILING )
+    if ( !onFiber )
+        --sProfileDepth;
+    RecordJob( job->name, start, ProfileNow(), outermost );
+#endif
+
+    if ( mJobCounter.fetch_sub( 1, std::memory_order_acq_rel ) == 1 ) {
+        mJobCounter.notify_all();
+    }
+    FinishNode( idx );
+}
+
+uint Core::JobSystem::AllocateNode( void ) {
+    const bool  isWorker = sWorkerIndex < mWorkerQueueCount;
+    NodeArena & arena    = mNodeArenas[isWorker ? sWorkerIndex : mWorkerQueueCount];
+
+    while ( true ) {
+        if ( !isWorker )
+            Lock( arena.lock );
+
+        // Take over everything other threads have handed back since the last time the stack ran dry
+        if ( arena.freeCount == 0 ) {
+            uint idx = arena.remoteFree.exchange( sInvalidNode, std::memory_order_acquire );
+            while ( idx != sInvalidNode ) {
+                arena.freeNodes[arena.freeCount++] = idx;
+                idx = mJobNodes[idx].nextFree.load( std::memory_order_relaxed );
             }
         }
+
+        const uint idx = arena.freeCount ? arena.freeNodes[--arena.freeCount] : sInvalidNode;
+        if ( !isWorker )
+            Unlock( arena.lock );
+        if ( idx != sInvalidNode )
+            return idx;
+
+        // Every node of the arena is in flight, make progress on something else so that nodes get recycled
+        if ( !RunPendingJob() )
+            std::this_thread::yield();
+    }
+}
+
+void Core::JobSystem::ReleaseNode( uint idx ) {
+    JobNode & node = mJobNodes[idx];
+
+    Lock( node.lock );
+    node.finished = false;
+    node.continuations.clear();
+    uint gen = node.gen.load( std::memory_order_relaxed ) + 1;
+    node.gen.store( gen ? gen : 1, std::memory_order_release );
+    Unlock( node.lock );
+    node.gen.notify_all();
+
+    NodeArena & arena = mNodeArenas[node.arena];
+    if ( node.arena == sWorkerIndex ) {
+        arena.freeNodes[arena.freeCount++] = idx;
+        return;
     }
+
+    uint head = arena.remoteFree.load( std::memory_order_relaxed );
+    do {
+        node.nextFree.store( head, std::memory_order_relaxed );
+    } while ( !arena.remoteFree.compare_exchange_weak( head, idx, std::memory_order_release, std::memory_order_relaxed ) );
 }
 
+void Core::JobSystem::FinishNode( uint idx ) {
+    JobNode & node = mJobNodes[idx];
+    if ( node.unfinished.fetch_sub( 1, std::memory_order_acq_rel ) != 1 )
+        return;
 
+    // Once finished is set nobody appends to the continuations anymore, so they can be walked without the lock
+    Lock( node.lock );
+    node.finished = true;
+    Unlock( node.lock );
+
+    for ( const uint continuation : node.continuations )
+        ResolveDependency( continuation );
+
+    const JobHandle parent = node.parent;
+    ReleaseNode( idx );
+
+    // The parent node cannot have been recycled, since it was still counting us as unfinished
+    if ( parent.Valid() )
+        FinishNode( parent.mIndex );
+}
+
+void Core::JobSystem::ResolveDependency( uint idx ) {
+    if ( mJobNodes[idx].dependencies.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+        Enqueue( &mJobNodes[idx] );
+}
+
+bool Core::JobSystem::AddContinuation( JobHandle dependency, uint idx ) {
+    if ( !dependency.Valid() )
+        return false;
+
+    JobNode & node = mJobNodes[dependency.mIndex];
+    Lock( node.lock );
+    const bool pending = node.gen.load( std::memory_order_relaxed ) == dependency.mGen && !node.finished;
+    if ( pending )
+        node.continuations.push_back( idx );
+    Unlock( node.lock );
+    return pending;
+}
+
+bool Core::JobSystem::AddChild( JobHandle parent ) {
+    if ( !parent.Valid() )
+        return false;
+
+    JobNode & node = mJobNodes[parent.mIndex];
+    bool added = false;
+    Lock( node.lock );
+    if ( node.gen.load( std::memory_order_relaxed ) == parent.mGen ) {
+        // Only extend a parent that has not already dropped to zero, a finished subtree cannot be reopened
+        uint unfinished = node.unfinished.load( std::memory_order_relaxed );
+        while ( unfinished != 0 && !node.unfinished.compare_exchange_weak( unfinished, unfinished + 1, std::memory_order_acq_rel, std::memory_order_relaxed ) ) {}
+        added = unfinished != 0;
+    }
+    Unlock( node.lock );
+    return added;
+}
+
+#if defined( VAK_JOB_PROFILING )
+ulong Core::JobSystem::ProfileNow( void ) const {
+    return static_cast<ulong>( std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - mProfileEpoch ).count() );
+}
+
+Core::JobSystem::WorkerProfile & Core::JobSystem::CurrentProfile( void ) {
+    return mProfiles[sProfileSlot < mProfileCount - 1 ? sProfileSlot : mProfileCount - 1];
+}
+
+void Core::JobSystem::RecordJob( const char * name, ulong start, ulong end, bool countBusy ) {
+    WorkerProfile & profile = CurrentProfile();
+    profile.jobs.fetch_add( 1, std::memory_order_relaxed );
+    if ( countBusy )
+        profile.busyNs.fetch_add( end - start, std::memory_order_relaxed );
+
+    if ( mTracing.load( std::memory_order_relaxed ) ) {
+        Lock( profile.lock );
+        profile.events.push_back( TraceEvent { .name = name ? name : "Job", .start = start, .duration = end - start } );
+        Unlock( profile.lock );
+    }
+}
+
+Core::JobSystemStats Core::JobSystem::GetStats( void ) {
+    const ulong now = ProfileNow();
+    const auto snapshot = [&]( const WorkerProfile & profile, WorkerGroup group ) {
+        const ulong busy  = profile.busyNs.load( std::memory_order_relaxed );
+        const ulong alive = now > profile.startNs ? now - profile.startNs : 0;
+        return JobWorkerStats {
+            .group         = group,
+            .jobsExecuted  = profile.jobs.load( std::memory_order_relaxed ),
+            .busyMs        = busy / 1e6,
+            .idleMs        = alive > busy ? ( alive - busy ) / 1e6 : 0.0,
+            .stealAttempts = profile.stealAttempts.load( std::memory_order_relaxed ),
+            .steals        = profile.steals.load( std::memory_order_relaxed )
+        };
+    };
+
+    JobSystemStats stats;
+    stats.workers.reserve( mProfileCount - 1 );
+    for ( uint slot = 0; slot < mWorkerQueueCount; ++slot ) {
+        JobWorkerStats & worker = stats.workers.emplace_back( snapshot( mProfiles[slot], WorkerGroup::Compute ) );
+        if ( mScheduler == JobScheduler::WorkStealing ) {
+            for ( uint p = 0; p < sPriorityCount; ++p )
+                worker.queuedJobs[p] = mWorkerQueues[slot].queues[p].Size();
+        }
+    }
+    for ( uint slot = mWorkerQueueCount; slot < mProfileCount - 1; ++slot )
+        stats.workers.push_back( snapshot( mProfiles[slot], WorkerGroup::IO ) );
+    stats.external = snapshot( mProfiles[mProfileCount - 1], WorkerGroup::Compute );
+
+    {
+        std::lock_guard<std::mutex> lock( mJobQueueMutex );
+        stats.sharedQueued[0] = static_cast<uint>( mHighQueue.size() );
+        stats.sharedQueued[1] = static_cast<uint>( mNormalQueue.size() );
+        stats.sharedQueued[2] = static_cast<uint>( mLowQueue.size() );
+        for ( const DeadlineEntry & entry : mDeadlineQueue )
+            ++stats.sharedQueued[PriorityIndex( entry.job->priority )];
+    }
+    {
+        std::lock_guard<std::mutex> lock( mIoQueueMutex );
+        stats.ioQueued = static_cast<uint>( mIoQueue.size() );
+    }
+    return stats;
+}
+
+void Core::JobSystem::BeginTrace( void ) {
+    for ( uint i = 0; i < mProfileCount; ++i ) {
+        Lock( mProfiles[i].lock );
+        mProfiles[i].events.clear();
+        Unlock( mProfiles[i].lock );
+    }
+    mTracing.store( true, std::memory_order_relaxed );
+}
+
+bool Core::JobSystem::EndTrace( const std::filesystem::path & path ) {
+    mTracing.store( false, std::memory_order_relaxed );
+
+    std::ofstream ofs( path );
+    if ( !ofs ) {
+        printf( "[ERROR] Failed to write job trace %s\n", path.string().c_str() );
+        return false;
+    }
+
+    // Job names are string literals, only quotes and backslashes need escaping
+    const auto escape = []( const char * name ) {
+        std::string escaped;
+        for ( ; *name; ++name ) {
+            if ( *name == '"' || *name == '\\' )
+                escaped += '\\';
+            escaped += *name;
+        }
+        return escaped;
+    };
+
+    // One track per profile, timestamps in microseconds
+    ofs << std::fixed << std::setprecision( 3 ) << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    ulong eventCount = 0;
+    for ( uint i = 0; i < mProfileCount; ++i ) {
+        const std::string thread = i < mWorkerQueueCount ? "Worker " + std::to_string( i ) : i < mProfileCount - 1 ? "I/O " + std::to_string( i - mWorkerQueueCount ) : "External";
+        ofs << ( first ? "" : "," ) << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << i << ",\"args\":{\"name\":\"" << thread << "\"}}";
+        first = false;
+
+        Lock( mProfiles[i].lock );
+        for ( const TraceEvent & event : mProfiles[i].events ) {
+            ofs << ",\n{\"name\":\"" << escape( event.name ) << "\",\"cat\":\"job\",\"ph\":\"X\",\"pid\":0,\"tid\":" << i
+                << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << event.duration / 1000.0 << "}";
+        }
+        eventCount += mProfiles[i].events.size();
+        mProfiles[i].events.clear();
+        Unlock( mProfiles[i].lock );
+    }
+    ofs << "\n]}\n";
+
+    printf( "[INFO] Wrote %llu job events to %s\n", static_cast<unsigned long long>( eventCount ), path.string().c_str() );
+    return true;
+}
+#endif
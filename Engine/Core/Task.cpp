@@ -0,0 +1,19 @@
+#include <Core/Task.hpp>
+
+#include <fstream>
+
+Core::Task<std::vector<_byte>> Core::ReadFileAsync( std::filesystem::path path ) {
+    // The read blocks, so it goes to the I/O workers and leaves the compute workers alone
+    co_await Schedule { .priority = JobPriority::Low, .group = WorkerGroup::IO, .name = "ReadFile" };
+
+    std::vector<_byte> data;
+    std::ifstream ifs( path, std::ios::binary | std::ios::ate );
+    if ( !ifs )
+        co_return data;
+
+    data.resize( static_cast<size_t>( ifs.tellg() ) );
+    ifs.seekg( 0, std::ios::beg );
+    if ( !ifs.read( reinterpret_cast<char *>( data.data() ), data.size() ) )
+        data.clear();
+    co_return data;
+}
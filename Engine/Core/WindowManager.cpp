@@ -104,7 +104,7 @@ void Core::WindowManager::InitWindow( void ) {
 void Core::WindowManager::Run( void ) {
     MSG msg = {};
 
-    Rhi::Renderer::Instance()->Init( mWinResolution, mWindowHandle );
+    Rhi::Renderer::Instance()->Init( mWinResolution, mWindowHandle, mJobSpec );
 
     LARGE_INTEGER currentTime;
     while ( !mShouldClose ) {
@@ -4,15 +4,15 @@
 #include <Renderer/Device.hpp>
 #include <Renderer/RenderStatistics.hpp>
 
-void Rhi::CommandList::BeginRendering( Util::TextureHandle fbHandle, Util::TextureHandle dbHandle ) {
+void Rhi::CommandList::BeginRendering( Util::TextureHandle fbHandle, Util::TextureHandle dbHandle, VkRenderingFlags flags ) {
     Texture * fb = Device::Instance()->GetTexturePool()->Get( fbHandle );
     assert( fb );
 
-    ImageBarrier( fb, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL );
+    ImageBarrier( fbHandle, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL );
     VkRenderingAttachmentInfo colorAttachment = {
         .sType       = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
         .imageView   = fb->view,
-        .imageLayout = fb->layout,
+        .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
         .loadOp      = VK_ATTACHMENT_LOAD_OP_CLEAR,
         .storeOp     = VK_ATTACHMENT_STORE_OP_STORE,
         .clearValue  = { .color = { 0.0f, 0.0f, 0.0f, 1.0f } }
@@ -21,11 +21,11 @@ void Rhi::CommandList::BeginRendering( Util::TextureHandle fbHandle, Util::Textu
     VkRenderingAttachmentInfo depthAttachment = {};
     if ( dbHandle.Valid() ) {
         Texture * db = Device::Instance()->GetTexturePool()->Get( dbHandle );
-        ImageBarrier( db, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL );
+        ImageBarrier( dbHandle, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL );
         depthAttachment = {
             .sType       = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
             .imageView   = db->view,
-            .imageLayout = db->layout,
+            .imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
             .loadOp      = VK_ATTACHMENT_LOAD_OP_CLEAR,
             .storeOp     = VK_ATTACHMENT_STORE_OP_STORE,
             .clearValue  = { .depthStencil = { .depth = 0.0f } }
@@ -35,6 +35,7 @@ void Rhi::CommandList::BeginRendering( Util::TextureHandle fbHandle, Util::Textu
     const VkRect2D renderArea = { { 0, 0 }, { fb->extent.width, fb->extent.height } };
     VkRenderingInfoKHR renderInfo = {
         .sType                = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR,
+        .flags                = flags,
         .renderArea           = renderArea,
         .layerCount           = 1,
         .viewMask             = 0,
@@ -53,20 +54,33 @@ void Rhi::CommandList::EndRendering( void ) {
     vkCmdEndRendering( mBuf );
 }
 
+void Rhi::CommandList::ExecuteCommands( std::span<CommandList * const> lists ) {
+    // Executed in batches so any number of lists fits the stack array
+    VkCommandBuffer buffers[16];
+    for ( size_t first = 0; first < lists.size(); first += std::size( buffers ) ) {
+        const size_t count = std::min( std::size( buffers ), lists.size() - first );
+        for ( size_t i = 0; i < count; ++i ) {
+            VK_VERIFY( vkEndCommandBuffer( lists[first + i]->mBuf ) );
+            buffers[i] = lists[first + i]->mBuf;
+        }
+        vkCmdExecuteCommands( mBuf, static_cast<uint>( count ), buffers );
+    }
+}
+
 void Rhi::CommandList::Draw( uint vertexCount, uint instanceCount, uint firstVertex, uint firstInstance ) {
-    RenderStats::Instance()->cpuDrawCalls++;
+    RenderStats::Instance()->cpuDrawCalls.fetch_add( 1, std::memory_order_relaxed );
     vkCmdDraw( mBuf, vertexCount, instanceCount, firstVertex, firstInstance );
 }
 
 void Rhi::CommandList::DrawIndexed( uint indexCount, uint instanceCount, uint firstIndex, uint vertexOffset, uint firstInstance ) {
-    RenderStats::Instance()->cpuDrawCalls++;
+    RenderStats::Instance()->cpuDrawCalls.fetch_add( 1, std::memory_order_relaxed );
     vkCmdDrawIndexed( mBuf, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance );
 }
 
 void Rhi::CommandList::DrawIndexedIndirect( Util::BufferHandle indirectBuffer, uint drawCount ) {
     Buffer * buf = Device::Instance()->GetBufferPool()->Get( indirectBuffer );
-    RenderStats::Instance()->cpuDrawCalls++;
-    RenderStats::Instance()->indirectDrawCalls += drawCount;
+    RenderStats::Instance()->cpuDrawCalls.fetch_add( 1, std::memory_order_relaxed );
+    RenderStats::Instance()->indirectDrawCalls.fetch_add( drawCount, std::memory_order_relaxed );
     vkCmdDrawIndexedIndirect( mBuf, buf->buf, 0, drawCount, sizeof( VkDrawIndexedIndirectCommand ) );
 }
 
@@ -143,13 +157,14 @@ void Rhi::CommandList::BufferBarrier( Util::BufferHandle handle, VkPipelineStage
     vkCmdPipelineBarrier2( mBuf, &depInfo );
 }
 
-void Rhi::CommandList::ImageBarrier( Texture * tex, VkImageLayout newLayout ) {
+void Rhi::CommandList::ImageBarrier( Util::TextureHandle handle, VkImageLayout newLayout ) {
+    // Only the layout state column is touched, the view data and metadata stay out of the cache
+    TextureState * tex = Device::Instance()->GetTexturePool()->Get<TextureState>( handle );
     const auto [srcStage, srcAccess] = GetLayoutFlags( tex->layout );
     const auto [dstStage, dstAccess] = GetLayoutFlags( newLayout );
 
-    VkImageAspectFlags aspect = isDepthFormat( tex->format ) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
     VkImageSubresourceRange range = {
-        .aspectMask   = aspect,
+        .aspectMask   = tex->aspect,
         .baseMipLevel = 0,
         .levelCount   = tex->mips,
         .layerCount   = 1,
@@ -177,6 +192,85 @@ void Rhi::CommandList::ImageBarrier( Texture * tex, VkImageLayout newLayout ) {
     tex->layout = newLayout;
 }
 
+VkBufferMemoryBarrier2 Rhi::CommandList::ReleaseOwnership( Util::BufferHandle handle, QueueType dstQueue, VkPipelineStageFlags2 dstStage ) {
+    Buffer * buf = Device::Instance()->GetBufferPool()->Get( handle );
+    VkBufferMemoryBarrier2 barrier = {
+        .sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+        .srcStageMask        = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+        .srcAccessMask       = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        .dstStageMask        = VK_PIPELINE_STAGE_2_NONE,
+        .dstAccessMask       = VK_ACCESS_2_NONE,
+        .srcQueueFamilyIndex = Device::Instance()->GetQueueIndex( mQueue ),
+        .dstQueueFamilyIndex = Device::Instance()->GetQueueIndex( dstQueue ),
+        .buffer              = buf->buf,
+        .offset              = 0,
+        .size                = buf->size
+    };
+    const VkDependencyInfo depInfo = {
+        .sType                    = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .bufferMemoryBarrierCount = 1,
+        .pBufferMemoryBarriers    = &barrier
+    };
+    vkCmdPipelineBarrier2( mBuf, &depInfo );
+
+    // The acquiring side ignores the source scope, the semaphore wait already covers it
+    barrier.srcStageMask  = VK_PIPELINE_STAGE_2_NONE;
+    barrier.srcAccessMask = VK_ACCESS_2_NONE;
+    barrier.dstStageMask  = dstStage;
+    barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+    return barrier;
+}
+
+VkImageMemoryBarrier2 Rhi::CommandList::ReleaseOwnership( Util::TextureHandle handle, QueueType dstQueue, VkImageLayout newLayout ) {
+    TextureState * tex = Device::Instance()->GetTexturePool()->Get<TextureState>( handle );
+    const auto [srcStage, srcAccess] = GetLayoutFlags( tex->layout );
+    const auto [dstStage, dstAccess] = GetLayoutFlags( newLayout );
+
+    // Both halves have to name the same layouts, the transition happens in between
+    VkImageMemoryBarrier2 barrier = {
+        .sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+        .srcStageMask        = srcStage,
+        .srcAccessMask       = srcAccess,
+        .dstStageMask        = VK_PIPELINE_STAGE_2_NONE,
+        .dstAccessMask       = VK_ACCESS_2_NONE,
+        .oldLayout           = tex->layout,
+        .newLayout           = newLayout,
+        .srcQueueFamilyIndex = Device::Instance()->GetQueueIndex( mQueue ),
+        .dstQueueFamilyIndex = Device::Instance()->GetQueueIndex( dstQueue ),
+        .image               = tex->image,
+        .subresourceRange    = {
+            .aspectMask   = tex->aspect,
+            .baseMipLevel = 0,
+            .levelCount   = tex->mips,
+            .layerCount   = 1,
+        }
+    };
+    const VkDependencyInfo depInfo = {
+        .sType                   = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .imageMemoryBarrierCount = 1,
+        .pImageMemoryBarriers    = &barrier
+    };
+    vkCmdPipelineBarrier2( mBuf, &depInfo );
+    tex->layout = newLayout;
+
+    barrier.srcStageMask  = VK_PIPELINE_STAGE_2_NONE;
+    barrier.srcAccessMask = VK_ACCESS_2_NONE;
+    barrier.dstStageMask  = dstStage;
+    barrier.dstAccessMask = dstAccess;
+    return barrier;
+}
+
+void Rhi::CommandList::AcquireOwnership( std::span<const VkBufferMemoryBarrier2> buffers, std::span<const VkImageMemoryBarrier2> images ) {
+    const VkDependencyInfo depInfo = {
+        .sType                    = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .bufferMemoryBarrierCount = static_cast<uint>( buffers.size() ),
+        .pBufferMemoryBarriers    = buffers.data(),
+        .imageMemoryBarrierCount  = static_cast<uint>( images.size() ),
+        .pImageMemoryBarriers     = images.data()
+    };
+    vkCmdPipelineBarrier2( mBuf, &depInfo );
+}
+
 void Rhi::CommandList::PushConstants( const void * data, uint size ) {
     assert( mBoundRP );
     vkCmdPushConstants( mBuf, mBoundRP->layout, mBoundRP->shaderStage, 0, size, data );
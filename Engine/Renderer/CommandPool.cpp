@@ -2,6 +2,7 @@
 #include <Renderer/Device.hpp>
 #include <Renderer/Swapchain.hpp>
 #include <Renderer/Timeline.hpp>
+#include <Core/JobSystem.hpp>
 
 void Rhi::CommandPool::Init( void ) {
     const VkCommandPoolCreateInfo ci = {
@@ -9,12 +10,13 @@ void Rhi::CommandPool::Init( void ) {
         .flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
         .queueFamilyIndex = Device::Instance()->GetQueueIndex( QueueType_Graphics )
     };
-    VK_VERIFY( vkCreateCommandPool( Device::Instance()->GetDevice(), &ci, nullptr, &mCommandPool ) );
 
     for ( uint i = 0; i < sMaxCommandLists; ++i ) {
+        VK_VERIFY( vkCreateCommandPool( Device::Instance()->GetDevice(), &ci, nullptr, &mCommandLists[i].mPool ) );
+
         const VkCommandBufferAllocateInfo ai = {
             .sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-            .commandPool        = mCommandPool,
+            .commandPool        = mCommandLists[i].mPool,
             .level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
             .commandBufferCount = 1
         };
@@ -33,14 +35,103 @@ void Rhi::CommandPool::Init( void ) {
 
 void Rhi::CommandPool::Destroy( void ) {
     for ( uint i = 0; i < sMaxCommandLists; ++i ) {
-        vkFreeCommandBuffers( Device::Instance()->GetDevice(), mCommandPool, 1, &mCommandLists[i].mBuf );
+        vkFreeCommandBuffers( Device::Instance()->GetDevice(), mCommandLists[i].mPool, 1, &mCommandLists[i].mBuf );
+        vkDestroyCommandPool( Device::Instance()->GetDevice(), mCommandLists[i].mPool, nullptr );
         vkDestroyFence( Device::Instance()->GetDevice(), mCommandLists[i].mFence, nullptr );
         vkDestroySemaphore( Device::Instance()->GetDevice(), mCommandLists[i].mSemaphore, nullptr );
     }
-    vkDestroyCommandPool( Device::Instance()->GetDevice(), mCommandPool, nullptr );
+    // Destroying a pool frees the secondary lists allocated from it
+    for ( FrameSlot & frame : mFrames ) {
+        for ( WorkerPool & worker : frame.workers ) {
+            if ( worker.pool )
+                vkDestroyCommandPool( Device::Instance()->GetDevice(), worker.pool, nullptr );
+        }
+        frame.workers.clear();
+    }
+}
+
+void Rhi::CommandPool::BeginFrame( void ) {
+    mFrameSlot = static_cast<uint>( Timeline::Instance()->GetCurrentFrame() % sFramesInFlight );
+    FrameSlot & frame = mFrames[mFrameSlot];
+    // Usually reached already, acquiring the swapchain image waited for an even later frame
+    Timeline::Instance()->WaitForValue( frame.value );
+
+    // The job system starts after the command pool, so the worker slots are only known from the first frame on
+    if ( frame.workers.empty() )
+        frame.workers = std::vector<WorkerPool>( Core::JobSystem::Instance()->GetWorkerSlotCount() );
+
+    for ( WorkerPool & worker : frame.workers ) {
+        if ( worker.used )
+            VK_VERIFY( vkResetCommandPool( Device::Instance()->GetDevice(), worker.pool, 0 ) );
+        worker.used = 0;
+    }
+}
+
+Rhi::CommandList * Rhi::CommandPool::AcquireSecondaryCommandList( Util::TextureHandle fbHandle, Util::TextureHandle dbHandle ) {
+    const uint workerIndex = Core::JobSystem::Instance()->GetWorkerIndex();
+    assert( workerIndex < mFrames[mFrameSlot].workers.size() );
+    WorkerPool & worker = mFrames[mFrameSlot].workers[workerIndex];
+
+    // Only this worker ever touches its pool, so neither creating nor allocating from it needs a lock
+    if ( !worker.pool ) {
+        const VkCommandPoolCreateInfo ci = {
+            .sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+            .queueFamilyIndex = Device::Instance()->GetQueueIndex( QueueType_Graphics )
+        };
+        VK_VERIFY( vkCreateCommandPool( Device::Instance()->GetDevice(), &ci, nullptr, &worker.pool ) );
+    }
+    if ( worker.used == worker.lists.size() ) {
+        CommandList & list = worker.lists.emplace_back();
+        const VkCommandBufferAllocateInfo ai = {
+            .sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool        = worker.pool,
+            .level              = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+            .commandBufferCount = 1
+        };
+        VK_VERIFY( vkAllocateCommandBuffers( Device::Instance()->GetDevice(), &ai, &list.mBuf ) );
+        Device::Instance()->RegisterDebugObjectName( VK_OBJECT_TYPE_COMMAND_BUFFER, (ulong)list.mBuf,
+            "Secondary CMDLIST " + std::to_string( mFrameSlot ) + "/" + std::to_string( workerIndex ) + "/" + std::to_string( worker.lists.size() - 1 ) );
+        list.mPool = worker.pool;
+    }
+    CommandList * list = &worker.lists[worker.used++];
+    list->mBoundRP = nullptr;
+
+    Texture * fb = Device::Instance()->GetTexturePool()->Get( fbHandle );
+    const VkFormat colorFormat = fb->format;
+    const VkCommandBufferInheritanceRenderingInfo renderingInfo = {
+        .sType                   = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+        .colorAttachmentCount    = 1,
+        .pColorAttachmentFormats = &colorFormat,
+        .depthAttachmentFormat   = dbHandle.Valid() ? Device::Instance()->GetTexturePool()->Get( dbHandle )->format : VK_FORMAT_UNDEFINED,
+        .rasterizationSamples    = VK_SAMPLE_COUNT_1_BIT
+    };
+    const VkCommandBufferInheritanceInfo inheritance = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .pNext = &renderingInfo
+    };
+    const VkCommandBufferBeginInfo beginInfo = {
+        .sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags            = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+        .pInheritanceInfo = &inheritance
+    };
+    VK_VERIFY( vkBeginCommandBuffer( list->mBuf, &beginInfo ) );
+
+    // Dynamic state is not inherited from the primary
+    const VkRect2D   renderArea = { { 0, 0 }, { fb->extent.width, fb->extent.height } };
+    const VkViewport viewport   = { 0.0f, 0.0f, (float)fb->extent.width, (float)fb->extent.height, 0.0f, 1.0f };
+    vkCmdSetScissor( list->mBuf, 0, 1, &renderArea );
+    vkCmdSetViewport( list->mBuf, 0, 1, &viewport );
+    return list;
+}
+
+void Rhi::CommandPool::SetSwapchainAcquireSemaphore( VkSemaphore acquire ) {
+    std::lock_guard<std::mutex> lock( mMutex );
+    mSwapchainAcquireSemaphore = acquire;
 }
 
 Rhi::CommandList * Rhi::CommandPool::AcquireCommandList( void ) {
+    std::lock_guard<std::mutex> lock( mMutex );
     while ( mCommandListCount == 0 ) {
         Purge();
     }
@@ -64,31 +155,45 @@ Rhi::CommandList * Rhi::CommandPool::AcquireCommandList( void ) {
     return list;
 }
 
-void Rhi::CommandPool::Submit( CommandList * list, Util::TextureHandle fb ) {
+void Rhi::CommandPool::Submit( CommandList * list, Util::TextureHandle fb, TimelinePoint signal, TimelinePoint wait ) {
+    std::lock_guard<std::mutex> lock( mMutex );
     uint signalSemaphoreCount = 1;
-    VkSemaphoreSubmitInfo semaphoresToSignal[2] = {
+    VkSemaphoreSubmitInfo semaphoresToSignal[3] = {
         { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO, .semaphore = list->mSemaphore, .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT },
+        { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO, .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT },
         { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO, .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT }
     };
     uint waitSemaphoreCount = 0;
-    VkSemaphoreSubmitInfo semaphoresToWait[2] = {
+    VkSemaphoreSubmitInfo semaphoresToWait[3] = {
+        { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO, .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT },
         { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO, .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT },
         { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO, .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT }
     };
     if ( mLastSubmitSemaphore ) semaphoresToWait[waitSemaphoreCount++].semaphore = mLastSubmitSemaphore;
     if ( mSwapchainAcquireSemaphore ) semaphoresToWait[waitSemaphoreCount++].semaphore = mSwapchainAcquireSemaphore;
+    if ( wait.semaphore ) {
+        semaphoresToWait[waitSemaphoreCount].semaphore = wait.semaphore;
+        semaphoresToWait[waitSemaphoreCount].value     = wait.value;
+        waitSemaphoreCount++;
+    }
 
     if ( fb.Valid() ) {
-        list->ImageBarrier( Device::Instance()->GetTexturePool()->Get( fb ), VK_IMAGE_LAYOUT_PRESENT_SRC_KHR );
+        list->ImageBarrier( fb, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR );
 
         const ulong nextFrameSignalValue = Timeline::Instance()->GetCurrentFrame() + Swapchain::Instance()->GetImageCount();
         Swapchain::Instance()->SetWaitValue( nextFrameSignalValue );
+        mFrames[mFrameSlot].value = nextFrameSignalValue;
 
         VkSemaphore timeline = Timeline::Instance()->GetTimeline();
         semaphoresToSignal[signalSemaphoreCount].semaphore = timeline;
         semaphoresToSignal[signalSemaphoreCount].value     = nextFrameSignalValue;
         signalSemaphoreCount++;
     }
+    if ( signal.semaphore ) {
+        semaphoresToSignal[signalSemaphoreCount].semaphore = signal.semaphore;
+        semaphoresToSignal[signalSemaphoreCount].value     = signal.value;
+        signalSemaphoreCount++;
+    }
     VK_VERIFY( vkEndCommandBuffer( list->mBuf ) );
 
     const VkCommandBufferSubmitInfo bufSI = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO, .commandBuffer = list->mBuf };
@@ -112,6 +217,7 @@ void Rhi::CommandPool::Submit( CommandList * list, Util::TextureHandle fb ) {
 }
 
 void Rhi::CommandPool::WaitAll( void ) {
+    std::lock_guard<std::mutex> lock( mMutex );
     VkFence allFences[sMaxCommandLists];
     uint unsignaledFenceCount = 0;
 
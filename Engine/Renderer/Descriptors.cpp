@@ -61,75 +61,83 @@ void Rhi::Descriptors::Destroy( void ) {
     vkDestroyDescriptorPool( Device::Instance()->GetDevice(), mDescriptorPool, nullptr );
 }
 
+void Rhi::Descriptors::ReleaseTextureSlot( uint slot ) {
+    std::lock_guard<std::mutex> lock( mReleasedMutex );
+    mReleasedTextureSlots.push_back( slot );
+    mShouldUpdateDescriptors = true;
+}
+
 void Rhi::Descriptors::UpdateDescriptorSets( void ) {
-    if ( !mShouldUpdateDescriptors )
+    if ( !mShouldUpdateDescriptors.exchange( false ) )
         return;
-    assert( Device::Instance()->GetTexturePool()->GetEntryCount() < sMaxTextures && "Exceeded max number of textures!" );
-
-    vector<VkDescriptorImageInfo> descriptorInfoSampledImages;
-    descriptorInfoSampledImages.reserve( Device::Instance()->GetTexturePool()->GetEntryCount() );
+    assert( Device::Instance()->GetTexturePool()->GetEntryCount() <= sMaxTextures && "Exceeded max number of textures!" );
 
     Util::TextureHandle dummy = Device::Instance()->GetTexturePool()->GetHandle( 0 );
     VkImageView dummyView = Device::Instance()->GetTexturePool()->Get( dummy )->view;
 
-    for ( uint i = 0; i < Device::Instance()->GetTexturePool()->GetObjectCount(); ++i ) {
-        Util::TextureHandle handle = Device::Instance()->GetTexturePool()->GetHandle( i );
-        if ( handle.Valid() ) {
-            Texture * tex = Device::Instance()->GetTexturePool()->Get( handle );
-
-            const bool isSampled = ( tex->usage & VK_IMAGE_USAGE_SAMPLED_BIT ) > 0;
-            descriptorInfoSampledImages.push_back( VkDescriptorImageInfo {
-                .sampler     = VK_NULL_HANDLE,
-                .imageView   = isSampled ? tex->view : dummyView,
-                .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-            });
-        }
+    // Slots of textures destroyed since the last update get the dummy so no descriptor refers to a destroyed view. A slot that
+    // was reused in the meantime is written again by the live entries below, which come later in the same update
+    vector<uint> textureSlots;
+    {
+        std::lock_guard<std::mutex> lock( mReleasedMutex );
+        textureSlots.swap( mReleasedTextureSlots );
     }
-
+    vector<VkDescriptorImageInfo> descriptorInfoSampledImages( textureSlots.size(), VkDescriptorImageInfo {
+        .sampler     = VK_NULL_HANDLE,
+        .imageView   = dummyView,
+        .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+    });
+
+    // Only live entries are visited, each one is written at its handle index
+    textureSlots.reserve( textureSlots.size() + Device::Instance()->GetTexturePool()->GetEntryCount() );
+    descriptorInfoSampledImages.reserve( descriptorInfoSampledImages.size() + Device::Instance()->GetTexturePool()->GetEntryCount() );
+
+    Device::Instance()->GetTexturePool()->ForEach<Texture>( [&]( Util::TextureHandle handle, const Texture & tex ) {
+        const bool isSampled = ( tex.usage & VK_IMAGE_USAGE_SAMPLED_BIT ) > 0;
+        textureSlots.push_back( handle.Index() );
+        descriptorInfoSampledImages.push_back( VkDescriptorImageInfo {
+            .sampler     = VK_NULL_HANDLE,
+            .imageView   = isSampled ? tex.view : dummyView,
+            .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+        });
+    });
+
+    vector<uint> samplerSlots;
     vector<VkDescriptorImageInfo> descriptorInfoSamplers;
+    samplerSlots.reserve( Device::Instance()->GetSamplerPool()->GetEntryCount() );
     descriptorInfoSamplers.reserve( Device::Instance()->GetSamplerPool()->GetEntryCount() );
 
-    for ( uint i = 0; i < Device::Instance()->GetSamplerPool()->GetObjectCount(); ++i ) {
-        Util::SamplerHandle handle = Device::Instance()->GetSamplerPool()->GetHandle( i );
-        if ( handle.Valid() ) {
-            Sampler * sampler = Device::Instance()->GetSamplerPool()->Get( handle );
-
-            // @todo: ugly hack, fix in Pool implementation
-            if ( sampler->sampler == nullptr )
-                continue;
-
-            descriptorInfoSamplers.push_back( VkDescriptorImageInfo {
-                .sampler     = sampler->sampler,
-                .imageView   = VK_NULL_HANDLE,
-                .imageLayout = VK_IMAGE_LAYOUT_UNDEFINED
-            });
-        }
-    }
-
-    VkWriteDescriptorSet write[Binding_MAX] = {};
-    uint numWrites = 0;
-
-    if ( !descriptorInfoSampledImages.empty() )
-        write[numWrites++] = {
+    Device::Instance()->GetSamplerPool()->ForEach<Sampler>( [&]( Util::SamplerHandle handle, const Sampler & sampler ) {
+        samplerSlots.push_back( handle.Index() );
+        descriptorInfoSamplers.push_back( VkDescriptorImageInfo {
+            .sampler     = sampler.sampler,
+            .imageView   = VK_NULL_HANDLE,
+            .imageLayout = VK_IMAGE_LAYOUT_UNDEFINED
+        });
+    });
+
+    vector<VkWriteDescriptorSet> writes;
+    writes.reserve( textureSlots.size() + samplerSlots.size() );
+    for ( uint i = 0; i < textureSlots.size(); ++i )
+        writes.push_back( VkWriteDescriptorSet {
             .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
             .dstSet          = mDescriptorSet,
             .dstBinding      = Binding_Textures,
-            .dstArrayElement = 0,
-            .descriptorCount = static_cast<uint>( descriptorInfoSampledImages.size() ),
+            .dstArrayElement = textureSlots[i],
+            .descriptorCount = 1,
             .descriptorType  = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
-            .pImageInfo      = descriptorInfoSampledImages.data()
-        };
-    if ( !descriptorInfoSamplers.empty() )
-        write[numWrites++] = {
+            .pImageInfo      = &descriptorInfoSampledImages[i]
+        });
+    for ( uint i = 0; i < samplerSlots.size(); ++i )
+        writes.push_back( VkWriteDescriptorSet {
             .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
             .dstSet          = mDescriptorSet,
             .dstBinding      = Binding_Samplers,
-            .dstArrayElement = 0,
-            .descriptorCount = static_cast<uint>( descriptorInfoSamplers.size() ),
+            .dstArrayElement = samplerSlots[i],
+            .descriptorCount = 1,
             .descriptorType  = VK_DESCRIPTOR_TYPE_SAMPLER,
-            .pImageInfo      = descriptorInfoSamplers.data()
-        };
+            .pImageInfo      = &descriptorInfoSamplers[i]
+        });
 
-    vkUpdateDescriptorSets( Device::Instance()->GetDevice(), numWrites, write, 0, nullptr );
-    mShouldUpdateDescriptors = false;
+    vkUpdateDescriptorSets( Device::Instance()->GetDevice(), static_cast<uint>( writes.size() ), writes.data(), 0, nullptr );
 }
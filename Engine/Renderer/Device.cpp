@@ -1,5 +1,7 @@
 #include <Renderer/Device.hpp>
 #include <Renderer/Descriptors.hpp>
+#include <Renderer/Swapchain.hpp>
+#include <Renderer/Timeline.hpp>
 
 void Rhi::Device::Init( void ) {
     CreateSurface();
@@ -20,18 +22,14 @@ void Rhi::Device::Init( void ) {
 }
 
 void Rhi::Device::Destroy( void ) {
-    for ( uint i = 0; i < mTexturePool.GetObjectCount(); ++i ) {
-        Util::TextureHandle handle = mTexturePool.GetHandle( i );
-        if ( handle.Valid() ) Delete( handle );
-    }
-    for ( uint i = 0; i < mBufferPool.GetObjectCount(); ++i ) {
-        Util::BufferHandle handle = mBufferPool.GetHandle( i );
-        if ( handle.Valid() ) Delete( handle );
-    }
-    for ( uint i = 0; i < mSamplerPool.GetObjectCount(); ++i ) {
-        Util::SamplerHandle handle = mSamplerPool.GetHandle( i );
-        if ( handle.Valid() ) Delete( handle );
-    }
+    // The device is idle by now, whatever is still queued goes right away together with everything that was never released
+    CollectGarbage( UINT64_MAX );
+    for ( Util::TextureHandle handle : mTexturePool.GetHandles() )
+        Destroy( handle );
+    for ( Util::BufferHandle handle : mBufferPool.GetHandles() )
+        Destroy( handle );
+    for ( Util::SamplerHandle handle : mSamplerPool.GetHandles() )
+        Destroy( handle );
 
     vmaDestroyAllocator( mVma );
     vkDestroyDevice( mLogicalDevice, nullptr );
@@ -169,6 +167,17 @@ void Rhi::Device::CreateLogicalDevice( void ) {
         .dynamicRendering = VK_TRUE
     };
 
+    // Optional, textures fall back to the staging device without it
+    VkPhysicalDeviceHostImageCopyFeaturesEXT hostImageCopyFeatures = {
+        .sType         = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_FEATURES_EXT,
+        .pNext         = &vkFeatures13,
+        .hostImageCopy = VK_TRUE
+    };
+    mHostImageCopy = QueryHostImageCopy();
+    if ( mHostImageCopy )
+        deviceExtensions.push_back( VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME );
+    printf("[Device] Host image copy %s\n", mHostImageCopy ? "enabled" : "unavailable");
+
     const float priority = 1.0f;
     vector<VkDeviceQueueCreateInfo> queueCIs = {
         VkDeviceQueueCreateInfo { .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
@@ -185,7 +194,7 @@ void Rhi::Device::CreateLogicalDevice( void ) {
 
     VkDeviceCreateInfo ci = {
         .sType                   = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-        .pNext                   = &vkFeatures13,
+        .pNext                   = mHostImageCopy ? static_cast<void *>( &hostImageCopyFeatures ) : &vkFeatures13,
         .queueCreateInfoCount    = static_cast<uint>( queueCIs.size() ),
         .pQueueCreateInfos       = queueCIs.data(),
         .enabledExtensionCount   = static_cast<uint>( deviceExtensions.size() ),
@@ -202,6 +211,60 @@ void Rhi::Device::CreateLogicalDevice( void ) {
     RegisterDebugObjectName( VK_OBJECT_TYPE_QUEUE, (ulong)mQueues.transfer, "Transfer Queue" );
 }
 
+bool Rhi::Device::QueryHostImageCopy( void ) const {
+    uint extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties( mPhysicalDevice, nullptr, &extensionCount, nullptr );
+    vector<VkExtensionProperties> extensions( extensionCount );
+    vkEnumerateDeviceExtensionProperties( mPhysicalDevice, nullptr, &extensionCount, extensions.data() );
+
+    const bool hasExtension = std::any_of( extensions.begin(), extensions.end(), []( const VkExtensionProperties & ext ) {
+        return strcmp( ext.extensionName, VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME ) == 0;
+    });
+    if ( !hasExtension )
+        return false;
+
+    VkPhysicalDeviceHostImageCopyFeaturesEXT features = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_FEATURES_EXT };
+    VkPhysicalDeviceFeatures2 features2 = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &features };
+    vkGetPhysicalDeviceFeatures2( mPhysicalDevice, &features2 );
+    if ( !features.hostImageCopy )
+        return false;
+
+    // Textures are copied straight into the layout they are sampled in, which the device has to allow as a copy destination
+    VkPhysicalDeviceHostImageCopyPropertiesEXT properties = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_PROPERTIES_EXT };
+    VkPhysicalDeviceProperties2 properties2 = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &properties };
+    vkGetPhysicalDeviceProperties2( mPhysicalDevice, &properties2 );
+    vector<VkImageLayout> dstLayouts( properties.copyDstLayoutCount );
+    properties.pCopyDstLayouts = dstLayouts.data();
+    vkGetPhysicalDeviceProperties2( mPhysicalDevice, &properties2 );
+
+    return std::find( dstLayouts.begin(), dstLayouts.end(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL ) != dstLayouts.end();
+}
+
+bool Rhi::Device::SupportsHostImageCopy( VkFormat format, VkImageUsageFlags usage ) const {
+    if ( !mHostImageCopy )
+        return false;
+
+    VkFormatProperties3 formatProperties3 = { .sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_3 };
+    VkFormatProperties2 formatProperties  = { .sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2, .pNext = &formatProperties3 };
+    vkGetPhysicalDeviceFormatProperties2( mPhysicalDevice, format, &formatProperties );
+    if ( !( formatProperties3.optimalTilingFeatures & VK_FORMAT_FEATURE_2_HOST_IMAGE_TRANSFER_BIT_EXT ) )
+        return false;
+
+    // Some devices drop compression or swizzling for host accessible images, those are better off going through staging
+    const VkPhysicalDeviceImageFormatInfo2 imageInfo = {
+        .sType  = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2,
+        .format = format,
+        .type   = VK_IMAGE_TYPE_2D,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage  = usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT
+    };
+    VkHostImageCopyDevicePerformanceQueryEXT performance = { .sType = VK_STRUCTURE_TYPE_HOST_IMAGE_COPY_DEVICE_PERFORMANCE_QUERY_EXT };
+    VkImageFormatProperties2 imageProperties = { .sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2, .pNext = &performance };
+    if ( vkGetPhysicalDeviceImageFormatProperties2( mPhysicalDevice, &imageInfo, &imageProperties ) != VK_SUCCESS )
+        return false;
+    return performance.optimalDeviceAccess;
+}
+
 void Rhi::Device::RegisterDebugObjectName( VkObjectType type, ulong handle, const std::string & name ) {
     VkDebugUtilsObjectNameInfoEXT ci = {
         .sType        = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT,
@@ -233,8 +296,10 @@ Util::TextureHandle Rhi::Device::CreateTexture( const TextureSpecification & spe
         .extent = spec.extent,
         .type   = spec.type,
         .format = spec.format,
+        .usage  = spec.usage
+    };
+    TextureState state = {
         .layout = VK_IMAGE_LAYOUT_UNDEFINED,
-        .usage  = spec.usage,
         .mips   = spec.mipCount
     };
     TextureMetadata metadata = {
@@ -259,8 +324,8 @@ Util::TextureHandle Rhi::Device::CreateTexture( const TextureSpecification & spe
         .initialLayout         = VK_IMAGE_LAYOUT_UNDEFINED,
     };
     VmaAllocationCreateInfo ai = { .usage = spec.storage & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT ? VMA_MEMORY_USAGE_CPU_TO_GPU : VMA_MEMORY_USAGE_AUTO };
-    VK_VERIFY( vmaCreateImage( mVma, &ci, &ai, &tex.image, &metadata.alloc, nullptr ) );
-    RegisterDebugObjectName( VK_OBJECT_TYPE_IMAGE, (ulong)tex.image, metadata.debugName + " IMAGE" );
+    VK_VERIFY( vmaCreateImage( mVma, &ci, &ai, &state.image, &metadata.alloc, nullptr ) );
+    RegisterDebugObjectName( VK_OBJECT_TYPE_IMAGE, (ulong)state.image, metadata.debugName + " IMAGE" );
 
     if ( spec.storage & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT ) {
         vmaMapMemory( mVma, metadata.alloc, &metadata.ptr );
@@ -274,10 +339,17 @@ Util::TextureHandle Rhi::Device::CreateTexture( const TextureSpecification & spe
         aspect = VK_IMAGE_ASPECT_COLOR_BIT;
     }
 
-    tex.view = CreateImageView( tex.image, spec.format, spec.mipCount, aspect );
+    state.aspect = aspect;
+    tex.view = CreateImageView( state.image, spec.format, spec.mipCount, aspect );
     RegisterDebugObjectName( VK_OBJECT_TYPE_IMAGE_VIEW, (ulong)tex.view, metadata.debugName + " VIEW" );
 
-    Util::TextureHandle handle = mTexturePool.Create( std::move( tex ), std::move( metadata ) );
+    Util::TextureHandle handle = mTexturePool.Create( std::move( tex ), std::move( state ), std::move( metadata ) );
+    if ( !handle.Valid() ) {
+        vkDestroyImageView( mLogicalDevice, tex.view, nullptr );
+        if ( metadata.ptr ) vmaUnmapMemory( mVma, metadata.alloc );
+        vmaDestroyImage( mVma, state.image, metadata.alloc );
+        return {};
+    }
     if ( spec.data ) {
         StagingDevice::Instance()->Upload( handle, spec.data );
     }
@@ -286,28 +358,95 @@ Util::TextureHandle Rhi::Device::CreateTexture( const TextureSpecification & spe
 }
 
 Util::TextureHandle Rhi::Device::CreateTexture( ktxTexture2 * ktx, const std::string & debugName ) {
-    std::lock_guard<std::mutex> lock( mResourceCreationMutex );
+    // With host image copy the loading job writes the texture itself, so textures upload fully in parallel
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+    const bool copyOnHost = SupportsHostImageCopy( (VkFormat)ktx->vkFormat, usage );
+    if ( copyOnHost )
+        usage |= VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT;
+
+    // The texture pool is concurrent and the staging device serializes its own ring, loading jobs call this in parallel
     Util::TextureHandle handle = CreateTexture( TextureSpecification {
         .type      = VK_IMAGE_TYPE_2D,
         .format    = (VkFormat)ktx->vkFormat,
         .extent    = { ktx->baseWidth, ktx->baseHeight, ktx->baseDepth },
-        .usage     = VK_IMAGE_USAGE_SAMPLED_BIT,
+        .usage     = usage,
         .mipCount  = ktx->numLevels,
         .debugName = debugName
     });
-    StagingDevice::Instance()->Upload( handle, ktx );
+    if ( !handle.Valid() )
+        return {};
+    if ( copyOnHost )
+        CopyToImageOnHost( handle, ktx );
+    else
+        StagingDevice::Instance()->Upload( handle, ktx );
     return handle;
 }
 
-void Rhi::Device::Delete( Util::TextureHandle handle ) {
+void Rhi::Device::CopyToImageOnHost( Util::TextureHandle handle, ktxTexture2 * ktx ) {
+    TextureState * state = mTexturePool.Get<TextureState>( handle );
+    const VkImageSubresourceRange range = {
+        .aspectMask     = state->aspect,
+        .baseMipLevel   = 0,
+        .levelCount     = state->mips,
+        .baseArrayLayer = 0,
+        .layerCount     = 1
+    };
+
+    // The image is new, so the host transition only discards its undefined contents. Only this thread knows the image yet,
+    // which is all the external synchronization host copies ask for
+    const VkHostImageLayoutTransitionInfoEXT transition = {
+        .sType            = VK_STRUCTURE_TYPE_HOST_IMAGE_LAYOUT_TRANSITION_INFO_EXT,
+        .image            = state->image,
+        .oldLayout        = VK_IMAGE_LAYOUT_UNDEFINED,
+        .newLayout        = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        .subresourceRange = range
+    };
+    VK_VERIFY( vkTransitionImageLayoutEXT( mLogicalDevice, 1, &transition ) );
+
+    vector<VkMemoryToImageCopyEXT> regions( ktx->numLevels );
+    for ( uint i = 0; i < ktx->numLevels; ++i ) {
+        ktx_size_t mipOffset;
+        ktxTexture2_GetImageOffset( ktx, i, 0, 0, &mipOffset );
+
+        regions[i] = {
+            .sType             = VK_STRUCTURE_TYPE_MEMORY_TO_IMAGE_COPY_EXT,
+            .pHostPointer      = ktxTexture_GetData( ktxTexture(ktx) ) + mipOffset,
+            .memoryRowLength   = 0,
+            .memoryImageHeight = 0,
+            .imageSubresource = {
+                .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel       = i,
+                .baseArrayLayer = 0,
+                .layerCount     = 1
+            },
+            .imageOffset = { 0, 0, 0 },
+            .imageExtent = { std::max( 1u, ktx->baseWidth >> i ), std::max( 1u, ktx->baseHeight >> i ), 1 }
+        };
+    }
+    const VkCopyMemoryToImageInfoEXT copyInfo = {
+        .sType          = VK_STRUCTURE_TYPE_COPY_MEMORY_TO_IMAGE_INFO_EXT,
+        .dstImage       = state->image,
+        .dstImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        .regionCount    = static_cast<uint>( regions.size() ),
+        .pRegions       = regions.data()
+    };
+    VK_VERIFY( vkCopyMemoryToImageEXT( mLogicalDevice, &copyInfo ) );
+
+    // Host writes become visible to the device with the next queue submission, nothing else to wait for
+    state->layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+}
+
+void Rhi::Device::Destroy( Util::TextureHandle handle ) {
     Texture * tex = mTexturePool.Get( handle );
-    TextureMetadata * metadata = mTexturePool.GetMetadata( handle );
+    TextureState * state = mTexturePool.Get<TextureState>( handle );
+    TextureMetadata * metadata = mTexturePool.Get<TextureMetadata>( handle );
 
-    if ( !tex || !metadata )
+    if ( !tex || !state || !metadata )
         return;
     vkDestroyImageView( mLogicalDevice, tex->view, nullptr );
     if ( metadata->ptr )          vmaUnmapMemory( mVma, metadata->alloc );
-    if ( !metadata->isSwapchain ) vmaDestroyImage( mVma, tex->image, metadata->alloc );
+    if ( !metadata->isSwapchain ) vmaDestroyImage( mVma, state->image, metadata->alloc );
+    Descriptors::Instance()->ReleaseTextureSlot( handle.Index() );
     mTexturePool.Delete( handle );
 }
 
@@ -345,8 +484,14 @@ Util::BufferHandle Rhi::Device::CreateBuffer( const BufferSpecification & spec )
         if ( requirements.memoryTypeBits & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT )
             allocCI.requiredFlags |= VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
     }
+    // Device local buffers with initial data ask for memory the CPU can write straight into. On UMA, ReBAR and software
+    // rasterisers that is still device local, elsewhere VMA falls back to plain VRAM and the data goes through staging
+    if ( spec.ptr && !( buf.storage & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT ) )
+        allocCI.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
     allocCI.usage = VMA_MEMORY_USAGE_AUTO;
-    VK_VERIFY( vmaCreateBufferWithAlignment( mVma, &ci, &allocCI, 16, &buf.buf, &metadata.alloc, nullptr ) );
+
+    VmaAllocationInfo allocInfo = {};
+    VK_VERIFY( vmaCreateBufferWithAlignment( mVma, &ci, &allocCI, 16, &buf.buf, &metadata.alloc, &allocInfo ) );
 
     RegisterDebugObjectName( VK_OBJECT_TYPE_BUFFER, (ulong)buf.buf, metadata.debugName );
 
@@ -361,15 +506,31 @@ Util::BufferHandle Rhi::Device::CreateBuffer( const BufferSpecification & spec )
         buf.address = vkGetBufferDeviceAddress( mLogicalDevice, &addressInfo );
     }
 
+    VkMemoryPropertyFlags memoryFlags = 0;
+    vmaGetAllocationMemoryProperties( mVma, metadata.alloc, &memoryFlags );
+    void * mapped = metadata.ptr ? metadata.ptr : allocInfo.pMappedData;
+
+    // A host write is visible to every later queue submission, so a direct write needs neither a copy nor a barrier
+    const bool writeDirect = spec.ptr && mapped && ( memoryFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT );
+    if ( writeDirect ) {
+        memcpy( mapped, spec.ptr, spec.size );
+        VK_VERIFY( vmaFlushAllocation( mVma, metadata.alloc, 0, VK_WHOLE_SIZE ) );
+    }
+
     Util::BufferHandle handle = mBufferPool.Create( std::move( buf ), std::move( metadata ) );
-    if ( spec.ptr )
+    if ( !handle.Valid() ) {
+        if ( metadata.ptr ) vmaUnmapMemory( mVma, metadata.alloc );
+        vmaDestroyBuffer( mVma, buf.buf, metadata.alloc );
+        return {};
+    }
+    if ( spec.ptr && !writeDirect )
         StagingDevice::Instance()->Upload( handle, spec.ptr, spec.size );
     return handle;
 }
 
-void Rhi::Device::Delete( Util::BufferHandle handle ) {
+void Rhi::Device::Destroy( Util::BufferHandle handle ) {
     Buffer * buf = mBufferPool.Get( handle );
-    BufferMetadata * metadata = mBufferPool.GetMetadata( handle );
+    BufferMetadata * metadata = mBufferPool.Get<BufferMetadata>( handle );
     if ( !buf || !metadata )
         return;
     if ( metadata->ptr ) vmaUnmapMemory( mVma, metadata->alloc );
@@ -402,15 +563,49 @@ Util::SamplerHandle Rhi::Device::CreateSampler( const SamplerSpecification & spe
 
     RegisterDebugObjectName( VK_OBJECT_TYPE_SAMPLER, (ulong)sampler.sampler, metadata.debugName );
 
+    Util::SamplerHandle handle = mSamplerPool.Create( std::move( sampler ), std::move( metadata ) );
+    if ( !handle.Valid() ) {
+        vkDestroySampler( mLogicalDevice, sampler.sampler, nullptr );
+        return {};
+    }
     Descriptors::Instance()->SetUpdateDescriptors();
-    return mSamplerPool.Create( std::move( sampler ), std::move( metadata ) );
+    return handle;
 }
 
-void Rhi::Device::Delete( Util::SamplerHandle handle ) {
+void Rhi::Device::Destroy( Util::SamplerHandle handle ) {
     Sampler * sampler = mSamplerPool.Get( handle );
     if ( !sampler )
         return;
     vkDestroySampler( mLogicalDevice, sampler->sampler, nullptr );
+    mSamplerPool.Delete( handle );
+    Descriptors::Instance()->SetUpdateDescriptors();
+}
+
+void Rhi::Device::Delete( Util::TextureHandle handle ) { Release({ .handle = handle }); }
+void Rhi::Device::Delete( Util::BufferHandle handle )  { Release({ .handle = handle }); }
+void Rhi::Device::Delete( Util::SamplerHandle handle ) { Release({ .handle = handle }); }
+
+void Rhi::Device::Release( PendingDelete && pending ) {
+    if ( std::visit( []( auto handle ) { return !handle.Valid(); }, pending.handle ) )
+        return;
+    // The submit of the current frame signals this value, so it covers every frame that may have recorded the resource
+    pending.timelineValue = Timeline::Instance()->GetCurrentFrame() + Swapchain::Instance()->GetImageCount();
+
+    std::lock_guard<std::mutex> lock( mPendingDeleteMutex );
+    mPendingDeletes.push_back( std::move( pending ) );
+}
+
+void Rhi::Device::CollectGarbage( ulong completedValue ) {
+    std::deque<PendingDelete> expired;
+    {
+        std::lock_guard<std::mutex> lock( mPendingDeleteMutex );
+        while ( !mPendingDeletes.empty() && mPendingDeletes.front().timelineValue <= completedValue ) {
+            expired.push_back( std::move( mPendingDeletes.front() ) );
+            mPendingDeletes.pop_front();
+        }
+    }
+    for ( const PendingDelete & pending : expired )
+        std::visit( [this]( auto handle ) { Destroy( handle ); }, pending.handle );
 }
 
 ulong Rhi::Device::DeviceAddress( Util::BufferHandle handle ) {
@@ -59,10 +59,28 @@ void GUI::Renderer::Render( Rhi::CommandList * cmdlist ) {
     ImGui::Text( "FPS: %d", (int)Rhi::RenderStats::Instance()->fps );
     ImGui::Text( "Frametime: %.2f ms", 1000.0f / Rhi::RenderStats::Instance()->fps );
     ImGui::Text( "Render Resolution: %ux%u", Rhi::RenderStats::Instance()->renderResolution.x, Rhi::RenderStats::Instance()->renderResolution.y );
-    ImGui::Text( "Draw Calls (CPU): %u", Rhi::RenderStats::Instance()->cpuDrawCalls );
-    ImGui::Text( "Draw Calls (Indirect): %u", Rhi::RenderStats::Instance()->indirectDrawCalls );
+    ImGui::Text( "Draw Calls (CPU): %u", Rhi::RenderStats::Instance()->cpuDrawCalls.load( std::memory_order_relaxed ) );
+    ImGui::Text( "Draw Calls (Indirect): %u", Rhi::RenderStats::Instance()->indirectDrawCalls.load( std::memory_order_relaxed ) );
     ImGui::Text( "Total VRAM used: %.2f GB", Rhi::RenderStats::Instance()->vRamUsedGB );
     ImGui::Text( "Total Vertices: %u", Rhi::RenderStats::Instance()->totalVertices );
+    for ( const Util::PoolStats & pool : Rhi::RenderStats::Instance()->poolStats ) {
+        ImGui::Text( "%-15s pool: %5u live, %5u peak, %5u slots, %8llu freed", pool.name, pool.live, pool.highWater, pool.capacity,
+            static_cast<unsigned long long>( pool.deleted ) );
+    }
+    ImGui::Text( "Uploads: %.2f MB/frame, %llu ring stalls (%.1f ms)", Rhi::RenderStats::Instance()->uploadBytesPerFrame / ( 1024.0f * 1024.0f ),
+        static_cast<unsigned long long>( Rhi::RenderStats::Instance()->uploadStalls ), Rhi::RenderStats::Instance()->uploadStallMs );
+#if defined( VAK_JOB_PROFILING )
+    const Core::JobSystemStats & jobStats = Rhi::RenderStats::Instance()->jobStats;
+    ImGui::Text( "Jobs queued (shared): %u/%u/%u, I/O: %u", jobStats.sharedQueued[0], jobStats.sharedQueued[1], jobStats.sharedQueued[2], jobStats.ioQueued );
+    for ( size_t i = 0; i < jobStats.workers.size(); ++i ) {
+        const Core::JobWorkerStats & worker = jobStats.workers[i];
+        const double lifetime = worker.busyMs + worker.idleMs;
+        ImGui::Text( "%s %2zu: %8llu jobs, %5.1f%% busy, steals %llu/%llu, queued %u/%u/%u", worker.group == Core::WorkerGroup::IO ? "I/O   " : "Worker", i,
+            static_cast<unsigned long long>( worker.jobsExecuted ), lifetime > 0.0 ? 100.0 * worker.busyMs / lifetime : 0.0,
+            static_cast<unsigned long long>( worker.steals ), static_cast<unsigned long long>( worker.stealAttempts ),
+            worker.queuedJobs[0], worker.queuedJobs[1], worker.queuedJobs[2] );
+    }
+#endif
     ImGui::End();
     ImGui::PopStyleVar();
 
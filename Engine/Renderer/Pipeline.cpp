@@ -11,10 +11,8 @@ void Rhi::PipelineFactory::Init( void ) {
 }
 
 void Rhi::PipelineFactory::Destroy( void ) {
-    for ( uint i = 0; i < mRenderPipelinePool.GetObjectCount(); ++i ) {
-        Util::RenderPipelineHandle handle = mRenderPipelinePool.GetHandle( i );
-        if ( handle.Valid() ) Delete( handle );
-    }
+    for ( Util::RenderPipelineHandle handle : mRenderPipelinePool.GetHandles() )
+        Delete( handle );
     vkDestroyPipelineCache( Device::Instance()->GetDevice(), mPipelineCache, nullptr );
 }
 
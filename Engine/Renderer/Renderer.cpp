@@ -12,9 +12,12 @@
 #include <Core/SceneGraph.hpp>
 #include <Core/Input.hpp>
 #include <Core/JobSystem.hpp>
+#include <Core/ParallelFor.hpp>
 #include <stb_image.h>
 
-void Rhi::Renderer::Init( uint2 renderResolution, void * windowHandle ) {
+#include <chrono>
+
+void Rhi::Renderer::Init( uint2 renderResolution, void * windowHandle, const Core::JobSystemSpecification & jobSpec ) {
     DebugPrintStructSizes();
     mRenderResolution = renderResolution;
 
@@ -46,10 +49,18 @@ void Rhi::Renderer::Init( uint2 renderResolution, void * windowHandle ) {
     PipelineFactory::Instance()->Init();
     ShaderManager::Instance()->Init();
     GUI::Renderer::Instance()->Init( windowHandle );
-    Core::JobSystem::Instance()->Init();
-
+    Core::JobSystem::Instance()->Init( jobSpec );
+#if defined( VAK_JOB_PROFILING )
+    Core::JobSystem::Instance()->BeginTrace();
+#endif
+    const auto loadStart = std::chrono::high_resolution_clock::now();
     const bool sponzaOK = mSponza.LoadMeshFromFile( "assets/models/modern_sponza/NewSponza_Main_glTF_003.gltf", true, aiProcess_FlipUVs | aiProcess_GenSmoothNormals );
     const bool curtainsOK = mCurtains.LoadMeshFromFile( "assets/models/modern_sponza_curtains/NewSponza_Curtains_glTF.gltf", true, aiProcess_FlipUVs | aiProcess_GenSmoothNormals );
+    const auto loadEnd = std::chrono::high_resolution_clock::now();
+    printf( "[INFO] Sponza and curtains loaded in %.2f ms\n", std::chrono::duration<double, std::milli>( loadEnd - loadStart ).count() );
+#if defined( VAK_JOB_PROFILING )
+    Core::JobSystem::Instance()->EndTrace( "load_trace.json" );
+#endif
 
     shMainVert = ShaderManager::Instance()->LoadShader( { "assets/shaders/shader.vert.spv", "Main Vertex" } );
     shMainFrag = ShaderManager::Instance()->LoadShader( { "assets/shaders/shader.frag.spv", "Main Fragment" } );
@@ -129,12 +140,20 @@ void Rhi::Renderer::Init( uint2 renderResolution, void * windowHandle ) {
         .debugName = "Point Lights"
     });
 
+    StagingDevice::Instance()->Wait( StagingDevice::Instance()->Flush() );
     CommandPool::Instance()->WaitAll();
 }
 
 void Rhi::Renderer::Destroy( void ) {
+    StagingDevice::Instance()->Flush();
     vkDeviceWaitIdle( Device::Instance()->GetDevice() );
 
+    // Peaks as of the last frame, these are what pool sizes for production scenes get tuned from
+    for ( const Util::PoolStats & pool : RenderStats::Instance()->poolStats )
+        printf( "[INFO] %s Pool peaked at %u entries, %u slots allocated\n", pool.name, pool.highWater, pool.capacity );
+
+    mSponza.Unload();
+    mCurtains.Unload();
     Core::JobSystem::Instance()->Destroy();
     GUI::Renderer::Instance()->Destroy();
     ShaderManager::Instance()->Destroy();
@@ -153,9 +172,9 @@ void Rhi::Renderer::Resize( uint2 newResolution ) {
         return;
 
     mRenderResolution = newResolution;
-    vkDeviceWaitIdle( Device::Instance()->GetDevice() );
 
     ComputeProjectionMatrix();
+    // The old depth buffer is destroyed once the frames in flight are done with it, only the swapchain has to wait for them
     Device::Instance()->Delete( depthBuffer );
     depthBuffer = Device::Instance()->CreateTexture({
         .type      = VK_IMAGE_TYPE_2D,
@@ -165,70 +184,99 @@ void Rhi::Renderer::Resize( uint2 newResolution ) {
         .storage   = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
         .debugName = "Depth"
     });
+    Timeline::Instance()->WaitForValue( Timeline::Instance()->GetCurrentFrame() + Swapchain::Instance()->GetImageCount() - 1 );
     Swapchain::Instance()->Resize( mRenderResolution );
 }
 
 void Rhi::Renderer::Render( glm::vec3 cameraPosition, glm::mat4 view, float deltaTime ) {
+    // Uploads recorded since the last frame go out on the transfer queue, batches that already landed get acquired ahead of this frame
+    StagingDevice::Instance()->Flush();
     CommandList * cmdlist = CommandPool::Instance()->AcquireCommandList();
     currentSwapchain = Swapchain::Instance()->AcquireImage();
+    CommandPool::Instance()->BeginFrame();
+    Device::Instance()->CollectGarbage( Timeline::Instance()->GetCounterValue() );
 
     VmaTotalStatistics stats;
     vmaCalculateStatistics( Device::Instance()->GetVMA(), &stats );
     RenderStats::Instance()->vRamUsedGB = stats.total.statistics.allocationBytes / ( 1024.0f * 1024.0f * 1024.0f );
     RenderStats::Instance()->totalVertices = mSponza.GetVertexCount() + mCurtains.GetVertexCount();
     RenderStats::Instance()->renderResolution = mRenderResolution;
+    RenderStats::Instance()->poolStats = {
+        Device::Instance()->GetTexturePool()->GetStats(),
+        Device::Instance()->GetBufferPool()->GetStats(),
+        Device::Instance()->GetSamplerPool()->GetStats(),
+        ShaderManager::Instance()->GetShaderPool()->GetStats(),
+        PipelineFactory::Instance()->GetRenderPipelinePool()->GetStats()
+    };
+    const StagingStats staging = StagingDevice::Instance()->GetStats();
+    RenderStats::Instance()->uploadBytesPerFrame = staging.bytesQueued - mLastStagingStats.bytesQueued;
+    RenderStats::Instance()->uploadStalls = staging.stalls - mLastStagingStats.stalls;
+    RenderStats::Instance()->uploadStallMs = ( staging.stallUs - mLastStagingStats.stallUs ) / 1000.0f;
+    mLastStagingStats = staging;
+#if defined( VAK_JOB_PROFILING )
+    RenderStats::Instance()->jobStats = Core::JobSystem::Instance()->GetStats();
+#endif
 
     Descriptors::Instance()->UpdateDescriptorSets();
-    cmdlist->BeginRendering( currentSwapchain, depthBuffer );
-        struct PushConstants {
-            glm::mat4 viewProj;
-            ulong     lightBuffer;
-            uint      lightCount;      uint _pad1;
-            glm::vec3 cameraPosition;  uint _pad0;
-            ulong     transformBuffer;
-            ulong     drawParamBuffer;
-        };
 
-        PushConstants pc1 = {
-            .viewProj         = mProjection * view,
-            .lightBuffer      = Device::Instance()->DeviceAddress( lightBuffer ),
-            .lightCount       = lightCount,
-            .cameraPosition   = cameraPosition,
-            .transformBuffer  = Device::Instance()->DeviceAddress( mSponza.mTransformBuffer ),
-            .drawParamBuffer  = Device::Instance()->DeviceAddress( mSponza.mDrawParamBuffer ),
-        };
-        static_assert( sizeof( PushConstants ) <= 128 );
-
-        cmdlist->BeginDebugLabel( "Sponza Opaque", { 1.0f, 0.0f, 1.0f, 1.0f } );
-            cmdlist->BindVertexBuffer( mSponza.mVertexBuffer );
-            cmdlist->BindIndexBuffer( mSponza.mIndexBuffer );
-            cmdlist->BindRenderPipeline( pipelineOpaque );
-            cmdlist->PushConstants( &pc1, sizeof( PushConstants ) );
-            cmdlist->DrawIndexedIndirect( mSponza.mOpaqueIndirectBuffer, mSponza.GetOpaqueMeshCount() );
-        cmdlist->EndDebugLabel();
-
-        PushConstants pc2 = {
-            .viewProj        = pc1.viewProj,
+    struct PushConstants {
+        glm::mat4 viewProj;
+        ulong     lightBuffer;
+        uint      lightCount;      uint _pad1;
+        glm::vec3 cameraPosition;  uint _pad0;
+        ulong     transformBuffer;
+        ulong     drawParamBuffer;
+    };
+    static_assert( sizeof( PushConstants ) <= 128 );
+
+    struct MeshPass {
+        const Mesh *               mesh;
+        Util::RenderPipelineHandle pipeline;
+        const char *               label;
+        float                      color[4];
+    };
+    const MeshPass passes[] = {
+        { .mesh = &mSponza,   .pipeline = pipelineOpaque, .label = "Sponza Opaque",   .color = { 1.0f, 0.0f, 1.0f, 1.0f } },
+        { .mesh = &mCurtains, .pipeline = pipelinePlane,  .label = "Sponza Curtains", .color = { 0.0f, 0.0f, 1.0f, 1.0f } }
+    };
+    const glm::mat4 viewProj = mProjection * view;
+
+    // Every pass records into its own secondary list on whichever worker picks it up, the lists execute in pass order
+    CommandList * passLists[std::size( passes ) + 1] = {};
+    Core::ParallelFor( 0, static_cast<uint>( std::size( passes ) ), 1, [&]( uint i ) {
+        const MeshPass & pass = passes[i];
+        const PushConstants pc = {
+            .viewProj        = viewProj,
             .lightBuffer     = Device::Instance()->DeviceAddress( lightBuffer ),
             .lightCount      = lightCount,
             .cameraPosition  = cameraPosition,
-            .transformBuffer = Device::Instance()->DeviceAddress( mCurtains.mTransformBuffer ),
-            .drawParamBuffer = Device::Instance()->DeviceAddress( mCurtains.mDrawParamBuffer )
+            .transformBuffer = Device::Instance()->DeviceAddress( pass.mesh->mTransformBuffer ),
+            .drawParamBuffer = Device::Instance()->DeviceAddress( pass.mesh->mDrawParamBuffer )
         };
 
-        cmdlist->BeginDebugLabel( "Sponza Curtains", { 0.0f, 0.0f, 1.0f, 1.0f } );
-            cmdlist->BindVertexBuffer( mCurtains.mVertexBuffer );
-            cmdlist->BindIndexBuffer( mCurtains.mIndexBuffer );
-            cmdlist->BindRenderPipeline( pipelinePlane );
-            cmdlist->PushConstants( &pc2, sizeof( PushConstants ) );
-            cmdlist->DrawIndexedIndirect( mCurtains.mOpaqueIndirectBuffer, mCurtains.GetOpaqueMeshCount() );
-        cmdlist->EndDebugLabel();
-
-        if ( Input::KeyboardInputs::Instance()->GetKey( Input::Key_G ) ) {
-            cmdlist->BeginDebugLabel( "GUI", { 0.0f, 1.0f, 0.0f, 1.0f } );
-            GUI::Renderer::Instance()->Render( cmdlist );
-            cmdlist->EndDebugLabel();
-        }
+        CommandList * list = CommandPool::Instance()->AcquireSecondaryCommandList( currentSwapchain, depthBuffer );
+        list->BeginDebugLabel( pass.label, pass.color );
+            list->BindVertexBuffer( pass.mesh->mVertexBuffer );
+            list->BindIndexBuffer( pass.mesh->mIndexBuffer );
+            list->BindRenderPipeline( pass.pipeline );
+            list->PushConstants( &pc, sizeof( PushConstants ) );
+            list->DrawIndexedIndirect( pass.mesh->mOpaqueIndirectBuffer, pass.mesh->GetOpaqueMeshCount() );
+        list->EndDebugLabel();
+        passLists[i] = list;
+    });
+
+    // ImGui is not thread safe, its list is recorded here and goes last
+    uint passListCount = static_cast<uint>( std::size( passes ) );
+    if ( Input::KeyboardInputs::Instance()->GetKey( Input::Key_G ) ) {
+        CommandList * list = CommandPool::Instance()->AcquireSecondaryCommandList( currentSwapchain, depthBuffer );
+        list->BeginDebugLabel( "GUI", { 0.0f, 1.0f, 0.0f, 1.0f } );
+        GUI::Renderer::Instance()->Render( list );
+        list->EndDebugLabel();
+        passLists[passListCount++] = list;
+    }
+
+    cmdlist->BeginRendering( currentSwapchain, depthBuffer, VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT );
+    cmdlist->ExecuteCommands( { passLists, passListCount } );
     cmdlist->EndRendering();
 
     CommandPool::Instance()->Submit( cmdlist, currentSwapchain );
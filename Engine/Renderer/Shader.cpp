@@ -2,10 +2,8 @@
 #include <Renderer/Device.hpp>
 
 void Rhi::ShaderManager::Destroy( void ) {
-    for ( uint i = 0; i < mShaderPool.GetObjectCount(); ++i ) {
-        Util::ShaderHandle handle = mShaderPool.GetHandle( i );
-        if ( handle.Valid() ) Delete( handle );
-    }
+    for ( Util::ShaderHandle handle : mShaderPool.GetHandles() )
+        Delete( handle );
 }
 
 Util::ShaderHandle Rhi::ShaderManager::LoadShader( const ShaderSpecification & spec ) {
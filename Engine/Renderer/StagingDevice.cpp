@@ -3,119 +3,388 @@
 #include <Renderer/CommandPool.hpp>
 #include <ktx.h>
 
+#include <chrono>
+#include <thread>
+
 void Rhi::StagingDevice::Init( void ) {
-    mStagingBufferCapacity = 512 * 1024 * 1024; // @todo: need to check against device limits
+    // Uploads stream through in slices, so the capacity only bounds how much is in flight
     mStagingBuffer = Device::Instance()->CreateBuffer({
         .usage     = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
         .storage   = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-        .size      = mStagingBufferCapacity,
+        .size      = sSegmentCount * sSegmentSize,
         .debugName = "Staging Device"
     });
-    mStagingBufferSize = 0;
-    mCurrentOffset     = 0;
+    mStagingPtr = static_cast<_byte *>( Device::Instance()->GetBufferPool()->Get<BufferMetadata>( mStagingBuffer )->ptr );
+    for ( Segment & segment : mSegments ) {
+        segment.head    = 0;
+        segment.pending = 0;
+        segment.value   = 0;
+    }
+    mCurrentSegment = 0;
+    mSubmittedValue = 0;
+    mAcquiredValue  = 0;
+
+    const VkCommandPoolCreateInfo ci = {
+        .sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = Device::Instance()->GetQueueIndex( QueueType_Transfer )
+    };
+    VK_VERIFY( vkCreateCommandPool( Device::Instance()->GetDevice(), &ci, nullptr, &mTransferPool ) );
+
+    for ( uint i = 0; i < sMaxBatches; ++i ) {
+        const VkCommandBufferAllocateInfo ai = {
+            .sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool        = mTransferPool,
+            .level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1
+        };
+        VK_VERIFY( vkAllocateCommandBuffers( Device::Instance()->GetDevice(), &ai, &mBatches[i].list.mBuf ) );
+        Device::Instance()->RegisterDebugObjectName( VK_OBJECT_TYPE_COMMAND_BUFFER, (ulong)mBatches[i].list.mBuf, "Transfer Batch " + std::to_string(i) );
+        mBatches[i].list.mQueue = QueueType_Transfer;
+    }
 
-    VkFenceCreateInfo fci = { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
-    VK_VERIFY( vkCreateFence( Device::Instance()->GetDevice(), &fci, nullptr, &mStagingFence ) );
+    const VkSemaphoreTypeCreateInfo typeCI = {
+        .sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue  = 0
+    };
+    const VkSemaphoreCreateInfo semCI = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &typeCI
+    };
+    VK_VERIFY( vkCreateSemaphore( Device::Instance()->GetDevice(), &semCI, nullptr, &mTimeline ) );
+    Device::Instance()->RegisterDebugObjectName( VK_OBJECT_TYPE_SEMAPHORE, (ulong)mTimeline, "Staging Timeline Semaphore" );
 }
 
 void Rhi::StagingDevice::Destroy( void ) {
-    vkDestroyFence( Device::Instance()->GetDevice(), mStagingFence, nullptr );
+    // The renderer flushes before the command pool goes away, nothing may still be queued here
+    assert( mQueue.empty() );
+    for ( uint i = 0; i < sMaxBatches; ++i )
+        vkFreeCommandBuffers( Device::Instance()->GetDevice(), mTransferPool, 1, &mBatches[i].list.mBuf );
+    vkDestroyCommandPool( Device::Instance()->GetDevice(), mTransferPool, nullptr );
+    vkDestroySemaphore( Device::Instance()->GetDevice(), mTimeline, nullptr );
+    mPendingAcquire.clear();
 }
 
-void Rhi::StagingDevice::Upload( Util::BufferHandle handle, const void * data, size_t size ) {
-    BufferMetadata * staging = Device::Instance()->GetBufferPool()->GetMetadata( mStagingBuffer );
-    Buffer * buf = Device::Instance()->GetBufferPool()->Get( handle );
+Rhi::StagingStats Rhi::StagingDevice::GetStats( void ) const {
+    return {
+        .bytesQueued = mBytesQueued.load( std::memory_order_relaxed ),
+        .stalls      = mStalls.load( std::memory_order_relaxed ),
+        .stallUs     = mStallUs.load( std::memory_order_relaxed )
+    };
+}
 
-    memcpy( static_cast<_byte *>( staging->ptr ), data, size );
-    assert( size < mStagingBufferCapacity );
+ulong Rhi::StagingDevice::GetCounterValue( void ) const {
+    ulong value = 0;
+    VK_VERIFY( vkGetSemaphoreCounterValue( Device::Instance()->GetDevice(), mTimeline, &value ) );
+    return value;
+}
 
-    VkPipelineStageFlags2 dstFlags = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
-    if ( buf->usage & VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT ) dstFlags |= VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT;
-    if ( buf->usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT ) dstFlags |= VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT;
-    if ( buf->usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT ) dstFlags |= VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT;
+void Rhi::StagingDevice::WaitForValue( ulong value ) {
+    // Inside a fiber the job is parked and the worker runs other jobs until the copy has landed
+    if ( Core::JobSystem::Instance()->IsOnFiber() ) {
+        Core::JobSystem::Instance()->WaitUntil( [this, value] { return GetCounterValue() >= value; } );
+        return;
+    }
 
-    CommandList * cmdlist = CommandPool::Instance()->AcquireCommandList();
-        VkBufferCopy copy = { .srcOffset = mCurrentOffset, .dstOffset = 0, .size = size };
-        cmdlist->Copy( mStagingBuffer, handle, &copy );
-        cmdlist->BufferBarrier( handle, VK_PIPELINE_STAGE_2_TRANSFER_BIT, dstFlags );
-    CommandPool::Instance()->Submit( cmdlist );
+    const VkSemaphoreWaitInfo waitInfo = {
+        .sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .semaphoreCount = 1,
+        .pSemaphores    = &mTimeline,
+        .pValues        = &value
+    };
+    VK_VERIFY( vkWaitSemaphores( Device::Instance()->GetDevice(), &waitInfo, UINT64_MAX ) );
+}
 
-    vkWaitForFences( Device::Instance()->GetDevice(), 1, &cmdlist->mFence, VK_TRUE, UINT64_MAX );
-    // vkResetFences( Device::Instance()->GetDevice(), 1, &cmdlist->mFence );
+void Rhi::StagingDevice::Wait( UploadToken token ) {
+    std::lock_guard<Core::JobMutex> lock( mMutex );
+    if ( token.value > mSubmittedValue.load( std::memory_order_acquire ) )
+        FlushLocked();
+    // The copy landing is not enough, graphics also has to have taken ownership
+    while ( !IsComplete( token ) ) {
+        WaitForValue( token.value );
+        AcquireCompleted();
+    }
 }
 
-void Rhi::StagingDevice::Upload( Util::TextureHandle handle, const void * data ) {
-    BufferMetadata * staging = Device::Instance()->GetBufferPool()->GetMetadata( mStagingBuffer );
-    Texture * tex = Device::Instance()->GetTexturePool()->Get( handle );
+Rhi::StagingSlice Rhi::StagingDevice::Reserve( size_t size ) {
+    assert( size <= sMaxSliceSize );
+    const size_t aligned = ( size + sAlignment - 1 ) & ~( sAlignment - 1 );
 
-    const uint size = tex->extent.width * tex->extent.height * 4;
-    memcpy( static_cast<_byte *>( staging->ptr ), data, size );
-    assert( size < mStagingBufferCapacity );
+    for ( ;; ) {
+        const uint index = mCurrentSegment.load( std::memory_order_acquire );
+        Segment & segment = mSegments[index];
 
-    CommandList * cmdlist = CommandPool::Instance()->AcquireCommandList();
-        cmdlist->ImageBarrier( tex, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL );
-        VkBufferImageCopy copy = {
-            .bufferOffset      = mCurrentOffset,
-            .bufferRowLength   = 0,
-            .bufferImageHeight = 0,
-            .imageSubresource = {
-                .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
-                .mipLevel       = 0,
-                .baseArrayLayer = 0,
-                .layerCount     = 1
-            },
-            .imageOffset = { 0, 0, 0 },
-            .imageExtent = tex->extent
-        };
-        cmdlist->Copy( mStagingBuffer, tex->image, &copy );
-        cmdlist->ImageBarrier( tex, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
-    CommandPool::Instance()->Submit( cmdlist );
+        // Counted before the bump, so the segment cannot be recycled underneath a slice that made it in
+        segment.pending.fetch_add( 1, std::memory_order_acq_rel );
+        const size_t offset = segment.head.fetch_add( aligned, std::memory_order_acq_rel );
+        if ( offset + size <= sSegmentSize ) {
+            const size_t ringOffset = index * sSegmentSize + offset;
+            return { .ptr = mStagingPtr + ringOffset, .offset = ringOffset, .size = size };
+        }
+        segment.pending.fetch_sub( 1, std::memory_order_acq_rel );
+        AdvanceSegment( index );
+    }
+}
+
+void Rhi::StagingDevice::AdvanceSegment( uint full ) {
+    std::lock_guard<Core::JobMutex> lock( mMutex );
+    if ( mCurrentSegment.load( std::memory_order_acquire ) != full )
+        return; // Somebody else moved on already
+
+    const uint next = ( full + 1 ) % sSegmentCount;
+    Segment & segment = mSegments[next];
+    const auto stallStart = std::chrono::high_resolution_clock::now();
 
-    vkWaitForFences( Device::Instance()->GetDevice(), 1, &cmdlist->mFence, VK_TRUE, UINT64_MAX );
-    // vkResetFences( Device::Instance()->GetDevice(), 1, &cmdlist->mFence );
+    // Producers still writing into the segment only have to queue their copy, which never takes mMutex
+    const bool stall = segment.pending.load( std::memory_order_acquire ) != 0;
+    if ( Core::JobSystem::Instance()->IsOnFiber() )
+        Core::JobSystem::Instance()->WaitUntil( [&segment] { return segment.pending.load( std::memory_order_acquire ) == 0; } );
+    while ( segment.pending.load( std::memory_order_acquire ) )
+        std::this_thread::yield();
+
+    // Every segment boundary submits what is queued, which also stamps the segment with the last batch reading from it
+    FlushLocked();
+    const bool busy = GetCounterValue() < segment.value;
+    WaitForValue( segment.value );
+
+    if ( stall || busy ) {
+        const auto stallEnd = std::chrono::high_resolution_clock::now();
+        mStalls.fetch_add( 1, std::memory_order_relaxed );
+        mStallUs.fetch_add( std::chrono::duration_cast<std::chrono::microseconds>( stallEnd - stallStart ).count(), std::memory_order_relaxed );
+    }
+
+    segment.head.store( 0, std::memory_order_release );
+    mCurrentSegment.store( next, std::memory_order_release );
 }
 
-void Rhi::StagingDevice::Upload( Util::TextureHandle handle, ktxTexture2 * ktx ) {
-    BufferMetadata * staging = Device::Instance()->GetBufferPool()->GetMetadata( mStagingBuffer );
-    Texture * tex = Device::Instance()->GetTexturePool()->Get( handle );
+Rhi::UploadToken Rhi::StagingDevice::Enqueue( const StagingSlice & slice, Util::BufferHandle handle, size_t dstOffset, bool last ) {
+    return Enqueue( QueuedCopy {
+        .copy    = BufferCopy { .handle = handle, .copy = { .srcOffset = slice.offset, .dstOffset = dstOffset, .size = slice.size } },
+        .segment = static_cast<uint>( slice.offset / sSegmentSize ),
+        .last    = last
+    }, slice.size );
+}
 
-    ktx_size_t stagingOffset = 0, mipOffset;
-    vector<ktx_size_t> stagingMipOffsets( ktx->numLevels );
-    for ( uint i = 0; i < ktx->numLevels; ++i ) {
-        ktxTexture2_GetImageOffset( ktx, i, 0, 0, &mipOffset );
+Rhi::UploadToken Rhi::StagingDevice::Enqueue( const StagingSlice & slice, Util::TextureHandle handle, const VkBufferImageCopy & region, bool last ) {
+    VkBufferImageCopy copy = region;
+    copy.bufferOffset = slice.offset;
+    return Enqueue( QueuedCopy {
+        .copy    = ImageCopy { .handle = handle, .copy = copy },
+        .segment = static_cast<uint>( slice.offset / sSegmentSize ),
+        .last    = last
+    }, slice.size );
+}
 
-        const ktx_size_t mipsize = ktxTexture_GetLevelSize( ktxTexture(ktx), i );
+Rhi::UploadToken Rhi::StagingDevice::Enqueue( QueuedCopy && copy, size_t size ) {
+    mBytesQueued.fetch_add( size, std::memory_order_relaxed );
+
+    const uint segment = copy.segment;
+    UploadToken token;
+    {
+        std::lock_guard<std::mutex> lock( mQueueMutex );
+        mQueue.push_back( std::move( copy ) );
+        token.value = mSubmittedValue.load( std::memory_order_relaxed ) + 1;
+    }
+    // Let go only once the copy is queued, the flush that recycles the segment is then sure to record it
+    mSegments[segment].pending.fetch_sub( 1, std::memory_order_acq_rel );
+    return token;
+}
+
+Rhi::UploadToken Rhi::StagingDevice::Flush( void ) {
+    std::lock_guard<Core::JobMutex> lock( mMutex );
+    return FlushLocked();
+}
+
+Rhi::UploadToken Rhi::StagingDevice::FlushLocked( void ) {
+    vector<QueuedCopy> copies;
+    ulong value = 0;
+    {
+        std::lock_guard<std::mutex> lock( mQueueMutex );
+        if ( !mQueue.empty() ) {
+            copies.swap( mQueue );
+            value = mSubmittedValue.fetch_add( 1, std::memory_order_acq_rel ) + 1;
+        }
+    }
+
+    if ( !copies.empty() ) {
+        TransferBatch * batch = AcquireBatch();
+        batch->value = value;
+        for ( const QueuedCopy & copy : copies )
+            Record( batch, copy );
+        VK_VERIFY( vkEndCommandBuffer( batch->list.mBuf ) );
 
-        _byte * dst = ktxTexture_GetData( ktxTexture(ktx) ) + mipOffset;
-        memcpy( static_cast<_byte*>( staging->ptr ) + stagingOffset, dst, mipsize );
+        const VkCommandBufferSubmitInfo bufSI = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO, .commandBuffer = batch->list.mBuf };
+        const VkSemaphoreSubmitInfo signal = {
+            .sType     = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+            .semaphore = mTimeline,
+            .value     = value,
+            .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT
+        };
+        const VkSubmitInfo2 submitInfo = {
+            .sType                    = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+            .commandBufferInfoCount   = 1,
+            .pCommandBufferInfos      = &bufSI,
+            .signalSemaphoreInfoCount = 1,
+            .pSignalSemaphoreInfos    = &signal
+        };
+        VK_VERIFY( vkQueueSubmit2( Device::Instance()->GetQueue( QueueType_Transfer ), 1, &submitInfo, VK_NULL_HANDLE ) );
+        mPendingAcquire.push_back( batch );
+    }
+    AcquireCompleted();
+    return { .value = mSubmittedValue.load( std::memory_order_acquire ) };
+}
+
+void Rhi::StagingDevice::Record( TransferBatch * batch, const QueuedCopy & queued ) {
+    if ( const BufferCopy * copy = std::get_if<BufferCopy>( &queued.copy ) ) {
+        VkBufferCopy region = copy->copy;
+        batch->list.Copy( mStagingBuffer, copy->handle, &region );
 
-        stagingMipOffsets[i] = stagingOffset;
-        stagingOffset += mipsize;
+        if ( queued.last ) {
+            Buffer * buf = Device::Instance()->GetBufferPool()->Get( copy->handle );
+            VkPipelineStageFlags2 dstFlags = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+            if ( buf->usage & VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT ) dstFlags |= VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT;
+            if ( buf->usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT ) dstFlags |= VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT;
+            if ( buf->usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT ) dstFlags |= VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT;
+            // Earlier chunks may sit in earlier batches, queue order puts them ahead of the release in this one
+            batch->bufferAcquires.push_back( batch->list.ReleaseOwnership( copy->handle, QueueType_Graphics, dstFlags ) );
+        }
+    } else {
+        const ImageCopy & image = std::get<ImageCopy>( queued.copy );
+        TextureState * state = Device::Instance()->GetTexturePool()->Get<TextureState>( image.handle );
+        if ( state->layout != VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL )
+            batch->list.ImageBarrier( image.handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL );
+        VkBufferImageCopy region = image.copy;
+        batch->list.Copy( mStagingBuffer, state->image, &region );
+
+        if ( queued.last )
+            batch->imageAcquires.push_back( batch->list.ReleaseOwnership( image.handle, QueueType_Graphics, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL ) );
     }
 
+    // Whoever recycles the segment waits for this batch
+    mSegments[queued.segment].value = batch->value;
+}
+
+void Rhi::StagingDevice::AcquireCompleted( void ) {
+    // Only batches that already landed are acquired, so the graphics queue never ends up waiting on a copy
+    const ulong completed = GetCounterValue();
+    if ( mPendingAcquire.empty() || mPendingAcquire.front()->value > completed )
+        return;
+
+    ulong acquired = 0;
     CommandList * cmdlist = CommandPool::Instance()->AcquireCommandList();
-        cmdlist->ImageBarrier( tex, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL );
-        for( uint i = 0; i < ktx->numLevels; ++i ) {
-            const uint mipw = std::max( 1u, ktx->baseWidth >> i );
-            const uint miph = std::max( 1u, ktx->baseHeight >> i );
-
-            VkBufferImageCopy copy = {
-                .bufferOffset      = stagingMipOffsets[i],
-                .bufferRowLength   = 0,
-                .bufferImageHeight = 0,
-                .imageSubresource = {
-                    .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
-                    .mipLevel       = i,
-                    .baseArrayLayer = 0,
-                    .layerCount     = 1
-                },
-                .imageOffset = { 0, 0, 0 },
-                .imageExtent = { mipw, miph, 1 }
-            };
-            cmdlist->Copy( mStagingBuffer, tex->image, &copy );
+    while ( !mPendingAcquire.empty() && mPendingAcquire.front()->value <= completed ) {
+        TransferBatch * batch = mPendingAcquire.front();
+        mPendingAcquire.pop_front();
+
+        cmdlist->AcquireOwnership( batch->bufferAcquires, batch->imageAcquires );
+        batch->bufferAcquires.clear();
+        batch->imageAcquires.clear();
+        batch->inUse = false;
+        acquired = batch->value;
+    }
+    // The value is reached already, the wait is what makes the transfer queue's writes visible to graphics
+    CommandPool::Instance()->Submit( cmdlist, {}, {}, { .semaphore = mTimeline, .value = acquired } );
+    mAcquiredValue.store( acquired, std::memory_order_release );
+}
+
+Rhi::StagingDevice::TransferBatch * Rhi::StagingDevice::AcquireBatch( void ) {
+    TransferBatch * free = nullptr;
+    while ( !free ) {
+        for ( TransferBatch & batch : mBatches ) {
+            if ( !batch.inUse ) {
+                free = &batch;
+                break;
+            }
+        }
+        if ( !free ) {
+            // Every batch is either in flight or waiting for graphics to acquire it
+            WaitForValue( mPendingAcquire.front()->value );
+            AcquireCompleted();
         }
-        cmdlist->ImageBarrier( tex, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
-    CommandPool::Instance()->Submit( cmdlist );
+    }
+    free->inUse = true;
+
+    const VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    VK_VERIFY( vkResetCommandBuffer( free->list.mBuf, 0 ) );
+    VK_VERIFY( vkBeginCommandBuffer( free->list.mBuf, &beginInfo ) );
+    return free;
+}
 
-    vkWaitForFences( Device::Instance()->GetDevice(), 1, &cmdlist->mFence, VK_TRUE, UINT64_MAX );
+Rhi::UploadToken Rhi::StagingDevice::Upload( Util::BufferHandle handle, const void * data, size_t size ) {
+    UploadToken token;
+    for ( size_t copied = 0; copied < size; ) {
+        const size_t chunk = std::min( size - copied, sMaxSliceSize );
+        const StagingSlice slice = Reserve( chunk );
+        memcpy( slice.ptr, static_cast<const _byte *>( data ) + copied, chunk );
+
+        token = Enqueue( slice, handle, copied, copied + chunk == size );
+        copied += chunk;
+    }
+    return token;
+}
+
+Rhi::UploadToken Rhi::StagingDevice::UploadMip( Util::TextureHandle handle, const _byte * data, size_t size, uint mip, VkExtent3D extent, uint blockHeight, bool last ) {
+    // Bands of whole block rows, so a mip of any size streams through the ring one slice at a time
+    const uint   rows     = ( extent.height + blockHeight - 1 ) / blockHeight;
+    const size_t rowBytes = size / rows;
+    assert( rowBytes <= sMaxSliceSize );
+    const uint   bandRows = static_cast<uint>( sMaxSliceSize / rowBytes );
+
+    UploadToken token;
+    for ( uint row = 0; row < rows; row += bandRows ) {
+        const uint   count = std::min( bandRows, rows - row );
+        const StagingSlice slice = Reserve( count * rowBytes );
+        memcpy( slice.ptr, data + row * rowBytes, slice.size );
+
+        const uint y = row * blockHeight;
+        token = Enqueue( slice, handle, BandCopy( mip, extent, y, std::min( count * blockHeight, extent.height - y ) ), last && row + count == rows );
+    }
+    return token;
+}
+
+VkBufferImageCopy Rhi::StagingDevice::BandCopy( uint mip, VkExtent3D extent, uint y, uint height ) {
+    return {
+        .bufferRowLength   = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = {
+            .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel       = mip,
+            .baseArrayLayer = 0,
+            .layerCount     = 1
+        },
+        .imageOffset = { 0, static_cast<int>( y ), 0 },
+        .imageExtent = { extent.width, height, 1 }
+    };
+}
+
+Rhi::UploadToken Rhi::StagingDevice::Upload( Util::TextureHandle handle, const void * data ) {
+    Texture * tex = Device::Instance()->GetTexturePool()->Get( handle );
+    TextureState * state = Device::Instance()->GetTexturePool()->Get<TextureState>( handle );
+    const size_t size = static_cast<size_t>( tex->extent.width ) * tex->extent.height * 4;
+
+    // The whole image gets overwritten, so whatever it held is discarded and the transfer queue can take it without a release
+    state->layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    return UploadMip( handle, static_cast<const _byte *>( data ), size, 0, tex->extent, 1, true );
+}
+
+Rhi::UploadToken Rhi::StagingDevice::Upload( Util::TextureHandle handle, ktxTexture2 * ktx ) {
+    TextureState * state = Device::Instance()->GetTexturePool()->Get<TextureState>( handle );
+    // Everything we load is either RGBA8 or transcoded to BC7, whose blocks are 4 texels high
+    const uint blockHeight = ktx->isCompressed ? 4 : 1;
+    state->layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    UploadToken token;
+    for ( uint i = 0; i < ktx->numLevels; ++i ) {
+        ktx_size_t mipOffset;
+        ktxTexture2_GetImageOffset( ktx, i, 0, 0, &mipOffset );
+
+        const ktx_size_t mipsize = ktxTexture_GetLevelSize( ktxTexture(ktx), i );
+        const VkExtent3D extent  = { std::max( 1u, ktx->baseWidth >> i ), std::max( 1u, ktx->baseHeight >> i ), 1 };
+        token = UploadMip( handle, ktxTexture_GetData( ktxTexture(ktx) ) + mipOffset, mipsize, i, extent, blockHeight, i + 1 == ktx->numLevels );
+    }
+    return token;
 }
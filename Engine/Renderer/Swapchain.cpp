@@ -83,17 +83,17 @@ void Rhi::Swapchain::Resize( uint2 newResolution ) {
         VK_VERIFY( vkCreateImageView( Device::Instance()->GetDevice(), &ivci, nullptr, &swapchainViews[i] ) );
 
         Texture tex = {
-            .image  = swapchainImages[i],
             .view   = swapchainViews[i],
             .extent = { newResolution.x, newResolution.y, 1 },
             .type   = VK_IMAGE_TYPE_2D,
             .format = mSwapchainFormat
         };
+        TextureState state = { .image = swapchainImages[i] };
         TextureMetadata metadata = {
             .debugName   = "Swapchain " + std::to_string(i),
             .isSwapchain = true,
         };
-        mSwapchainImages[i] = Device::Instance()->GetTexturePool()->Create( std::move( tex ), std::move( metadata ) );
+        mSwapchainImages[i] = Device::Instance()->GetTexturePool()->Create( std::move( tex ), std::move( state ), std::move( metadata ) );
 
         VkSemaphoreCreateInfo sci = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
         VK_VERIFY( vkCreateSemaphore( Device::Instance()->GetDevice(), &sci, nullptr, &mAcquireSemaphores[i] ) );
@@ -102,14 +102,7 @@ void Rhi::Swapchain::Resize( uint2 newResolution ) {
 }
 
 Util::TextureHandle Rhi::Swapchain::AcquireImage( void ) {
-    VkSemaphore timeline = Timeline::Instance()->GetTimeline();
-    VkSemaphoreWaitInfo waitSemaphore = {
-        .sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR,
-        .semaphoreCount = 1,
-        .pSemaphores    = &timeline,
-        .pValues        = &mTimelineWaitValues[mCurrentImage]
-    };
-    VK_VERIFY( vkWaitSemaphores( Device::Instance()->GetDevice(), &waitSemaphore, UINT64_MAX ) );
+    Timeline::Instance()->WaitForValue( mTimelineWaitValues[mCurrentImage] );
 
     VkSemaphore acquire = mAcquireSemaphores[mCurrentImage];
     VK_VERIFY( vkAcquireNextImageKHR( Device::Instance()->GetDevice(), mSwapchain, UINT64_MAX, acquire, VK_NULL_HANDLE, &mCurrentImage ) );
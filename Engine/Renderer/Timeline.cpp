@@ -1,5 +1,6 @@
 #include <Renderer/Timeline.hpp>
 #include <Renderer/Device.hpp>
+#include <Core/JobSystem.hpp>
 
 void Rhi::Timeline::Init( void ) {
     const VkSemaphoreTypeCreateInfo typeCI = {
@@ -28,3 +29,24 @@ void Rhi::Timeline::SignalTimeline( ulong value ) {
     };
     VK_VERIFY( vkSignalSemaphore( Device::Instance()->GetDevice(), &signalInfo ) );
 }
+
+ulong Rhi::Timeline::GetCounterValue( void ) const {
+    ulong value = 0;
+    VK_VERIFY( vkGetSemaphoreCounterValue( Device::Instance()->GetDevice(), mTimeline, &value ) );
+    return value;
+}
+
+void Rhi::Timeline::WaitForValue( ulong value ) {
+    if ( Core::JobSystem::Instance()->IsOnFiber() ) {
+        Core::JobSystem::Instance()->WaitUntil( [this, value] { return GetCounterValue() >= value; } );
+        return;
+    }
+
+    const VkSemaphoreWaitInfo waitInfo = {
+        .sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .semaphoreCount = 1,
+        .pSemaphores    = &mTimeline,
+        .pValues        = &value
+    };
+    VK_VERIFY( vkWaitSemaphores( Device::Instance()->GetDevice(), &waitInfo, UINT64_MAX ) );
+}
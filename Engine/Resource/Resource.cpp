@@ -1,6 +1,8 @@
 #include <Resource/Resource.hpp>
 #include <Renderer/Device.hpp>
 #include <Core/JobSystem.hpp>
+#include <Core/ParallelFor.hpp>
+#include <Core/Task.hpp>
 
 namespace Resource {
     using namespace std;
@@ -24,10 +26,23 @@ namespace Resource {
         return result;
     }
 
+    static string CachedTexturePath( const fs::path & path ) {
+        return (*path.begin()).string() + "/.cache/" + path.stem().string() + ".bc7";
+    }
+
+    // Original texture + the mips down to 512 texels
+    static uint CountMips( uint width, uint height ) {
+        uint mipCount = 1;
+        while ( width > 512 && height > 512 ) {
+            width  = width >> 1;
+            height = height >> 1;
+            mipCount++;
+        }
+        return mipCount;
+    }
+
     ktxTexture2 * LoadTexture( const fs::path & path, bool shouldCompress ) {
-        const string filename   = path.stem().string();
-        const string cacheDir   = (*path.begin()).string() + "/.cache/";
-        const string compressed = cacheDir + filename + ".bc7";
+        const string compressed = CachedTexturePath( path );
 
         ktxTexture2 * texture;
         // check cache for compressed texture, else continue to loading and compressing
@@ -58,14 +73,7 @@ namespace Resource {
         }
         ci.baseWidth  = (uint)x;
         ci.baseHeight = (uint)y;
-
-        uint mipCount = 1; // Original texture + the resulting mips
-        while ( x > 512 && y > 512 ) {
-            x = x >> 1;
-            y = y >> 1;
-            mipCount++;
-        }
-        ci.numLevels = mipCount;
+        ci.numLevels  = CountMips( ci.baseWidth, ci.baseHeight );
 
         ktxResult createOK = ktxTexture2_Create( &ci, KTX_TEXTURE_CREATE_ALLOC_STORAGE, &texture );
         if ( createOK != KTX_SUCCESS ) {
@@ -75,20 +83,22 @@ namespace Resource {
         }
         memcpy( ktxTexture_GetData(ktxTexture(texture)), data, ci.baseWidth * ci.baseHeight * 4 );
 
-        for ( uint i = 0; i < ci.numLevels; ++i ) {
+        // Each mip is resized straight from the base level into its own region, so they are independent
+        Core::ParallelFor( 0, ci.numLevels, 1, [&]( uint i ) {
             const uint mipw = std::max<uint>( 1u, ci.baseWidth >> i );
             const uint miph = std::max<uint>( 1u, ci.baseHeight >> i );
 
-            const ktx_size_t mipsize = ktxTexture_GetLevelSize( ktxTexture(texture), i );
             ktx_size_t mipOffset;
             ktxTexture2_GetImageOffset( texture, i, 0, 0, &mipOffset );
 
             _byte * dst = ktxTexture_GetData( ktxTexture(texture) ) + mipOffset;
             stbir_resize_uint8_linear( data, ci.baseWidth, ci.baseHeight, 0, dst, mipw, miph, 0, STBIR_RGBA );
-        }
+        });
 
         if ( shouldCompress ) {
-            if ( x % 4 != 0 || y % 4 != 0 ) {
+            // Checked on the smallest level, the blocks of every mip have to line up
+            const uint lastMip = ci.numLevels - 1;
+            if ( ( ci.baseWidth >> lastMip ) % 4 != 0 || ( ci.baseHeight >> lastMip ) % 4 != 0 ) {
                 printf("Texture %s extent is not divisible by 4!\n", path.string().c_str());
                 stbi_image_free( data );
                 return nullptr;
@@ -115,14 +125,174 @@ namespace Resource {
         return texture;
     }
 
+    // The decoded image stays in memory as the resize source, every level is written straight into staging in bands of rows.
+    // The mips go first, so the last band of the base level is queued after all of them and hands the texture to graphics
+    static Util::TextureHandle StreamDecodedTexture( const fs::path & path, const string & name ) {
+        int x, y;
+        _byte * data = stbi_load( path.string().c_str(), &x, &y, nullptr, 4 );
+        if ( !data ) {
+            printf("Could not load image %s: %s\n", path.string().c_str(), stbi_failure_reason());
+            return {};
+        }
+        const uint width    = (uint)x;
+        const uint height   = (uint)y;
+        const uint mipCount = CountMips( width, height );
+
+        Util::TextureHandle handle = Rhi::Device::Instance()->CreateTexture( Rhi::TextureSpecification {
+            .type      = VK_IMAGE_TYPE_2D,
+            .format    = VK_FORMAT_R8G8B8A8_UNORM,
+            .extent    = { width, height, 1 },
+            .usage     = VK_IMAGE_USAGE_SAMPLED_BIT,
+            .mipCount  = mipCount,
+            .debugName = name
+        });
+        if ( !handle.Valid() ) {
+            stbi_image_free( data );
+            return {};
+        }
+        Rhi::StagingDevice * staging = Rhi::StagingDevice::Instance();
+
+        Core::ParallelFor( 1, mipCount, 1, [&]( uint i ) {
+            const VkExtent3D extent   = { std::max( 1u, width >> i ), std::max( 1u, height >> i ), 1 };
+            const size_t     rowBytes = extent.width * 4;
+            const uint       bandRows = static_cast<uint>( Rhi::StagingDevice::sMaxSliceSize / rowBytes );
+
+            for ( uint row = 0; row < extent.height; row += bandRows ) {
+                const uint count = std::min( bandRows, extent.height - row );
+                const Rhi::StagingSlice slice = staging->Reserve( count * rowBytes );
+
+                // The band is resized on its own from the matching stretch of the base level, the filter still reads past its edges
+                STBIR_RESIZE resize;
+                stbir_resize_init( &resize, data, width, height, 0, slice.ptr, extent.width, count, 0, STBIR_RGBA, STBIR_TYPE_UINT8 );
+                stbir_set_input_subrect( &resize, 0.0, (double)row / extent.height, 1.0, (double)( row + count ) / extent.height );
+                stbir_resize_extended( &resize );
+                staging->Enqueue( slice, handle, Rhi::StagingDevice::BandCopy( i, extent, row, count ), false );
+            }
+        });
+
+        const size_t rowBytes = width * 4;
+        const uint   bandRows = static_cast<uint>( Rhi::StagingDevice::sMaxSliceSize / rowBytes );
+        for ( uint row = 0; row < height; row += bandRows ) {
+            const uint count = std::min( bandRows, height - row );
+            const Rhi::StagingSlice slice = staging->Reserve( count * rowBytes );
+            memcpy( slice.ptr, data + row * rowBytes, slice.size );
+            staging->Enqueue( slice, handle, Rhi::StagingDevice::BandCopy( 0, { width, height, 1 }, row, count ), row + count == height );
+        }
+        stbi_image_free( data );
+        return handle;
+    }
+
+    // Only the header is parsed by libktx, the levels are read from the file straight into staging slices.
+    // Returns an invalid handle when the cache can not be read, the caller decodes the source image instead
+    static Util::TextureHandle StreamCachedTexture( const string & filename, const string & name ) {
+        ktxTexture2 * ktx;
+        ktxResult loadOK = ktxTexture2_CreateFromNamedFile( filename.c_str(), KTX_TEXTURE_CREATE_NO_FLAGS, &ktx );
+        if ( loadOK != KTX_SUCCESS ) {
+            printf("Loading %s from cache failed %u\n", filename.c_str(), loadOK);
+            return {};
+        }
+
+        // libktx gives level offsets relative to the image data, which ends the file with the base level
+        ifstream ifs( filename, ios::binary | ios::ate );
+        const streamoff fileSize = ifs ? static_cast<streamoff>( ifs.tellg() ) : 0;
+        // The cache is written after transcoding, so the levels are plain BC7 blocks
+        if ( !ifs || fileSize < static_cast<streamoff>( ktx->dataSize ) || ktx->supercompressionScheme != KTX_SS_NONE || !ktx->isCompressed ) {
+            printf("Reading %s from cache failed\n", filename.c_str());
+            ktxTexture2_Destroy( ktx );
+            return {};
+        }
+        const streamoff dataOffset = fileSize - static_cast<streamoff>( ktx->dataSize );
+
+        Util::TextureHandle handle = Rhi::Device::Instance()->CreateTexture( Rhi::TextureSpecification {
+            .type      = VK_IMAGE_TYPE_2D,
+            .format    = (VkFormat)ktx->vkFormat,
+            .extent    = { ktx->baseWidth, ktx->baseHeight, 1 },
+            .usage     = VK_IMAGE_USAGE_SAMPLED_BIT,
+            .mipCount  = ktx->numLevels,
+            .debugName = name
+        });
+        if ( !handle.Valid() ) {
+            ktxTexture2_Destroy( ktx );
+            return {};
+        }
+        Rhi::StagingDevice * staging = Rhi::StagingDevice::Instance();
+
+        // Levels are stored smallest first, reading them in that order keeps the file access sequential and ends on the base level
+        bool readOK = true;
+        Rhi::UploadToken token;
+        for ( int i = ktx->numLevels - 1; i >= 0; --i ) {
+            ktx_size_t mipOffset;
+            ktxTexture2_GetImageOffset( ktx, i, 0, 0, &mipOffset );
+
+            const VkExtent3D extent   = { std::max( 1u, ktx->baseWidth >> i ), std::max( 1u, ktx->baseHeight >> i ), 1 };
+            const uint       rows     = ( extent.height + 3 ) / 4;
+            const size_t     rowBytes = ktxTexture_GetImageSize( ktxTexture(ktx), i ) / rows;
+            const uint       bandRows = static_cast<uint>( Rhi::StagingDevice::sMaxSliceSize / rowBytes );
+
+            ifs.seekg( dataOffset + static_cast<streamoff>( mipOffset ) );
+            for ( uint row = 0; row < rows; row += bandRows ) {
+                const uint count = std::min( bandRows, rows - row );
+                const Rhi::StagingSlice slice = staging->Reserve( count * rowBytes );
+                // A short read still has to queue the slice, the ring only reuses segments whose slices were all queued
+                if ( !ifs.read( reinterpret_cast<char *>( slice.ptr ), slice.size ) )
+                    readOK = false;
+                token = staging->Enqueue( slice, handle, Rhi::StagingDevice::BandCopy( i, extent, row * 4, std::min( count * 4, extent.height - row * 4 ) ),
+                                          i == 0 && row + count == rows );
+            }
+        }
+        ktxTexture2_Destroy( ktx );
+
+        // The texture holds garbage. Deletes only follow the graphics timeline, so the copies and the acquire that hands the
+        // image to graphics have to be done before it is released
+        if ( !readOK ) {
+            printf("Reading %s from cache failed\n", filename.c_str());
+            staging->Wait( token );
+            Rhi::Device::Instance()->Delete( handle );
+            return {};
+        }
+        return handle;
+    }
+
+    Util::TextureHandle StreamTexture( const fs::path & path, const std::string & name, bool shouldCompress ) {
+        const string   compressed = CachedTexturePath( path );
+        const bool     cached     = shouldCompress && fs::exists( compressed );
+        const VkFormat format     = cached ? VK_FORMAT_BC7_UNORM_BLOCK : VK_FORMAT_R8G8B8A8_UNORM;
+
+        // Compression needs the whole image in a ktx texture, and host image copy writes the image from memory itself
+        if ( ( shouldCompress && !cached ) || Rhi::Device::Instance()->SupportsHostImageCopy( format, VK_IMAGE_USAGE_SAMPLED_BIT ) ) {
+            ktxTexture2 * texture = LoadTexture( path, shouldCompress );
+            Util::TextureHandle handle = Rhi::Device::Instance()->CreateTexture( texture, name );
+            ktxTexture2_Destroy( texture );
+            return handle;
+        }
+        if ( cached ) {
+            Util::TextureHandle handle = StreamCachedTexture( compressed, name );
+            if ( handle.Valid() )
+                return handle;
+        }
+        return StreamDecodedTexture( path, name );
+    }
+
+    Core::Task<void> LoadTextureAsync( fs::path path, std::string name, bool shouldCompress, Util::TextureHandle & handle ) {
+        handle = StreamTexture( path, name, shouldCompress );
+        co_return;
+    }
+
     Resource::Mesh::~Mesh() {
-        // @todo: when scene editing is implemented, re-enable this and fix the bug in the Pool implementation
-        // Rhi::Device::Instance()->Delete( mVertexBuffer );
-        // Rhi::Device::Instance()->Delete( mIndexBuffer );
-        // Rhi::Device::Instance()->Delete( mIndirectBuffer );
-        // Rhi::Device::Instance()->Delete( mMaterialBuffer );
-        // Rhi::Device::Instance()->Delete( mTransformBuffer );
-        // Rhi::Device::Instance()->Delete( mDrawParamBuffer );
+        Unload();
+    }
+
+    void Resource::Mesh::Unload( void ) {
+        // Deletes only queue the resources on the device, so this is safe while frames using the mesh are still in flight
+        for ( Util::BufferHandle * buffer : { &mVertexBuffer, &mIndexBuffer, &mTransformBuffer, &mDrawParamBuffer, &mMaterialBuffer,
+                                              &mOpaqueIndirectBuffer, &mTransparentIndirectBuffer } ) {
+            if ( buffer->Valid() )
+                Rhi::Device::Instance()->Delete( *buffer );
+            *buffer = {};
+        }
+        for ( Util::TextureHandle texture : mTextures )
+            Rhi::Device::Instance()->Delete( texture );
+        mTextures.clear();
     }
 
     bool Resource::Mesh::LoadMeshFromFile( const fs::path & path, bool compressTextures, uint extraAssimpFlags ) {
@@ -165,22 +335,19 @@ namespace Resource {
         mOpaqueCount = totalOpaqueMeshes;
         mTransparentCount = totalTransparentMeshes;
 
-        std::mutex mapMutex;
-        for ( const auto & [path, _] : mTextureIdMap ) {
-            Core::JobSystem::Instance()->DispatchJob( [&] {
-                ktxTexture2 * texture = LoadTexture( parentPath.string() + path, compressTextures );
-                Util::TextureHandle handle = Rhi::Device::Instance()->CreateTexture( texture, path );
-                ktxTexture2_Destroy( texture );
-
-                std::lock_guard<std::mutex> lock( mapMutex );
-                mTextureIdMap[path] = handle.Index();
-            });
-        }
-
-        vector<Vertex> vertexData;
-        vertexData.reserve( totalVertices );
-        vector<uint> indexData;
-        indexData.reserve( totalIndices );
+        // Every texture is its own task writing to its own handle, they load while the geometry below gets converted
+        vector<Util::TextureHandle> textureHandles( mTextureIdMap.size() );
+        vector<Core::Task<void>> textureTasks;
+        textureTasks.reserve( mTextureIdMap.size() );
+        for ( auto handle = textureHandles.begin(); const auto & [path, textureId] : mTextureIdMap )
+            textureTasks.push_back( LoadTextureAsync( parentPath.string() + path, path, compressTextures, *handle++ ) );
+        Core::Task<void> textures = Core::WhenAll( std::move( textureTasks ) );
+        textures.Start();
+
+        vector<Vertex> vertexData( totalVertices );
+        vector<uint> indexData( totalIndices );
+        vector<uint> vertexOffsets( scene->mNumMeshes );
+        vector<uint> indexOffsets( scene->mNumMeshes );
         vector<VkDrawIndexedIndirectCommand> opaqueCmds;
         opaqueCmds.reserve( totalOpaqueMeshes );
         vector<DrawParameters> paramData;
@@ -191,25 +358,8 @@ namespace Resource {
         uint indexStart = 0, vertexStart = 0, opaqueIndex = 0, transparentIndex = 0;
         for ( uint i = 0; i < scene->mNumMeshes; ++i ) {
             const aiMesh * mesh = scene->mMeshes[i];
-
-            for ( uint vtx = 0; vtx < mesh->mNumVertices; ++vtx ) {
-                const aiVector3D pos  = mesh->mVertices[vtx];
-                const aiVector3D norm = mesh->mNormals[vtx];
-                const aiVector3D tang = mesh->mTangents[vtx];
-                const aiVector3D uv   = mesh->mTextureCoords[0][vtx];
-                vertexData.emplace_back( Vertex {
-                    .position = glm::vec3( pos.x, pos.y, pos.z ),
-                    .normal   = glm::packSnorm3x10_1x2( { norm.x, norm.y, norm.z, 0.0f } ),
-                    .tangent  = glm::packSnorm3x10_1x2( { tang.x, tang.y, tang.z, 0.0f } ),
-                    .uv       = glm::packHalf2x16( { uv.x, uv.y } )
-                });
-            }
-
-            for ( uint idx = 0; idx < mesh->mNumFaces; ++idx ) {
-                indexData.emplace_back( mesh->mFaces[idx].mIndices[0] );
-                indexData.emplace_back( mesh->mFaces[idx].mIndices[1] );
-                indexData.emplace_back( mesh->mFaces[idx].mIndices[2] );
-            }
+            vertexOffsets[i] = vertexStart;
+            indexOffsets[i]  = indexStart;
 
             const aiMaterial * material = scene->mMaterials[mesh->mMaterialIndex];
 
@@ -231,7 +381,40 @@ namespace Resource {
             indexStart  += mesh->mNumFaces * 3;
         }
         GetTransformMatrices( scene->mRootNode, scene, mTransform, transformData );
-        Core::JobSystem::Instance()->WaitAll();
+
+        // Every mesh writes to its own slice of the vertex and index data, so meshes convert in parallel
+        Core::ParallelFor( 0, scene->mNumMeshes, 1, [&]( uint i ) {
+            const aiMesh * mesh = scene->mMeshes[i];
+
+            Vertex * vertices = vertexData.data() + vertexOffsets[i];
+            for ( uint vtx = 0; vtx < mesh->mNumVertices; ++vtx ) {
+                const aiVector3D pos  = mesh->mVertices[vtx];
+                const aiVector3D norm = mesh->mNormals[vtx];
+                const aiVector3D tang = mesh->mTangents[vtx];
+                const aiVector3D uv   = mesh->mTextureCoords[0][vtx];
+                vertices[vtx] = Vertex {
+                    .position = glm::vec3( pos.x, pos.y, pos.z ),
+                    .normal   = glm::packSnorm3x10_1x2( { norm.x, norm.y, norm.z, 0.0f } ),
+                    .tangent  = glm::packSnorm3x10_1x2( { tang.x, tang.y, tang.z, 0.0f } ),
+                    .uv       = glm::packHalf2x16( { uv.x, uv.y } )
+                };
+            }
+
+            uint * indices = indexData.data() + indexOffsets[i];
+            for ( uint idx = 0; idx < mesh->mNumFaces; ++idx ) {
+                indices[idx * 3 + 0] = mesh->mFaces[idx].mIndices[0];
+                indices[idx * 3 + 1] = mesh->mFaces[idx].mIndices[1];
+                indices[idx * 3 + 2] = mesh->mFaces[idx].mIndices[2];
+            }
+        });
+        textures.Wait();
+        // A texture that failed to load keeps the invalid handle's index 0, so its materials sample the dummy texture
+        for ( auto handle = textureHandles.begin(); auto & [name, textureId] : mTextureIdMap ) {
+            textureId = handle->Index();
+            if ( handle->Valid() )
+                mTextures.push_back( *handle );
+            ++handle;
+        }
 
         mVertexBuffer = Rhi::Device::Instance()->CreateBuffer({
             .usage     = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
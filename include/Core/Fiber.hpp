@@ -0,0 +1,53 @@
+#pragma once
+#include <Util/Defines.hpp>
+
+#include <cstddef>
+
+#if !defined( _WIN32 ) && !defined( __x86_64__ )
+#include <ucontext.h>
+#endif
+
+namespace Core {
+
+    // Cooperative user-mode execution context with its own stack. Switching never crosses threads, a fiber is always resumed
+    // on the thread that created it. Windows uses the OS fibers, x86-64 SysV a hand written switch, anything else ucontext
+    class Fiber final {
+    public:
+        using Entry = void (*)( void * );
+
+        Fiber() = default;
+        Fiber( const Fiber & ) = delete;
+        Fiber & operator =( const Fiber & ) = delete;
+        ~Fiber() { Destroy(); }
+
+        // Adopts the calling thread, so that fibers created on it have a context to switch back to
+        void InitFromThread( void );
+        // The entry point must never return, it switches away for the last time instead
+        void Init( Entry, void *, size_t stackSize );
+        void Destroy( void );
+
+        // Saves the running context into from and resumes to
+        static void Switch( Fiber & from, Fiber & to );
+
+    private:
+#if defined( _WIN32 )
+        void * mHandle     = nullptr;
+        bool   mFromThread = false;
+#elif defined( __x86_64__ )
+        void * mStackPointer = nullptr;
+#else
+        ucontext_t mContext;
+#endif
+        void * mStack     = nullptr;
+        size_t mStackSize = 0;
+        Entry  mEntry     = nullptr;
+        void * mArg       = nullptr;
+
+#if defined( _WIN32 )
+        static void __stdcall Start( void * );
+#elif !defined( __x86_64__ )
+        static void Start( uint, uint );
+#endif
+    };
+
+}
@@ -1,18 +1,88 @@
 #pragma once
 #include <Util/Defines.hpp>
 #include <Util/Singleton.hpp>
+#include <Util/WorkStealingDeque.hpp>
+#include <Core/Fiber.hpp>
 
-#include <functional>
 #include <thread>
 #include <vector>
 #include <mutex>
 #include <condition_variable>
 #include <queue>
 #include <atomic>
+#include <memory>
+#include <span>
+#include <utility>
+#include <new>
+#include <cstddef>
+#include <type_traits>
+
+#if defined( VAK_JOB_PROFILING )
+#include <chrono>
+#include <filesystem>
+#endif
 
 namespace Core {
 
-    using Job = std::function<void()>;
+    // Move-only callable with inline capture storage, dispatching a job never touches the heap.
+    // Captures that do not fit are a compile error, capture by reference or put the state behind a pointer instead
+    class Job final {
+    public:
+        static constexpr uint sStorageSize = 64;
+
+        Job() = default;
+
+        template<typename Function> requires ( !std::is_same_v<std::decay_t<Function>, Job> )
+        Job( Function && fn ) {
+            using Callable = std::decay_t<Function>;
+            static_assert( sizeof( Callable ) <= sStorageSize, "Job capture is too large!" );
+            static_assert( alignof( Callable ) <= alignof( std::max_align_t ), "Job capture is over-aligned!" );
+            static_assert( std::is_nothrow_move_constructible_v<Callable> );
+
+            new ( mStorage ) Callable( std::forward<Function>( fn ) );
+            mInvoke = []( void * storage ) { ( *static_cast<Callable *>( storage ) )(); };
+            mManage = []( void * dst, void * src ) {
+                if ( dst )
+                    new ( dst ) Callable( std::move( *static_cast<Callable *>( src ) ) );
+                static_cast<Callable *>( src )->~Callable();
+            };
+        }
+
+        Job( Job && other ) noexcept { MoveFrom( other ); }
+        Job & operator =( Job && other ) noexcept {
+            if ( this != &other ) {
+                Reset();
+                MoveFrom( other );
+            }
+            return *this;
+        }
+        Job( const Job & ) = delete;
+        Job & operator =( const Job & ) = delete;
+        ~Job() { Reset(); }
+
+        void operator ()() { mInvoke( mStorage ); }
+        explicit operator bool() const { return mInvoke != nullptr; }
+
+        // Destroys the captured state
+        void Reset( void ) {
+            if ( mManage )
+                mManage( nullptr, mStorage );
+            mInvoke = nullptr;
+            mManage = nullptr;
+        }
+
+    private:
+        alignas( std::max_align_t ) _byte mStorage[sStorageSize];
+        void ( *mInvoke )( void * )         = nullptr;
+        void ( *mManage )( void *, void * ) = nullptr; // Moves src into dst (if any) and destroys src
+
+        void MoveFrom( Job & other ) {
+            if ( other.mManage )
+                other.mManage( mStorage, other.mStorage );
+            mInvoke = std::exchange( other.mInvoke, nullptr );
+            mManage = std::exchange( other.mManage, nullptr );
+        }
+    };
 
     enum class JobPriority : _byte {
         Low    = 1,
@@ -20,30 +90,368 @@ namespace Core {
         High   = 3
     };
 
+    // Same layout as Util::Handle, a stale handle (generation mismatch) refers to a job that has already completed
+    class JobHandle final {
+    public:
+        JobHandle() = default;
+
+        bool Valid( void ) const { return mGen != 0; }
+
+        bool operator ==( const JobHandle & other ) const { return mIndex == other.mIndex && mGen == other.mGen; }
+        bool operator !=( const JobHandle & other ) const { return mIndex != other.mIndex || mGen != other.mGen; }
+
+    private:
+        friend class JobSystem;
+        JobHandle( uint idx, uint gen ) : mIndex( idx ), mGen( gen ) {}
+
+        uint mIndex = 0;
+        uint mGen   = 0;
+    };
+
+    enum class WorkerGroup : _byte {
+        Compute, // Workers pinned to cores and sharing the deques, everything runs here unless routed elsewhere
+        IO       // A few unpinned threads for jobs that block on the OS (file reads), falls back to Compute when there are none
+    };
+
+    struct JobSpecification final {
+        JobPriority                priority     = JobPriority::High;
+        JobHandle                  parent       = {}; // The parent only completes once this job (and its own children) complete
+        std::span<const JobHandle> dependencies = {}; // The job is queued only after all of these complete
+        WorkerGroup                group        = WorkerGroup::Compute;
+        const char *               name         = nullptr; // Label in the trace, has to outlive the job. Ignored unless built with VAK_JOB_PROFILING
+        ulong                      deadline     = 0; // Deadline scheduler only, in JobSystem::Now() microseconds. 0 ages in from the dispatch time by priority
+    };
+
+    enum class JobScheduler : _byte {
+        Global,      // Single mutex guarding one FIFO per priority, kept around to A/B against work stealing
+        WorkStealing, // Per-worker Chase-Lev deques with randomized stealing
+        Deadline      // One shared queue ordered by deadline, the earliest one runs next. Background jobs get a deadline some time
+                      // after their dispatch, so they eventually overtake frame work instead of starving behind it
+    };
+
+    enum class JobBackend : _byte {
+        Threads, // Jobs run on the worker's own stack, waiting inside a job blocks the worker
+        Fibers   // Workers run jobs on a small pool of fibers, a job waiting with WaitUntil is parked and the worker moves on
+    };
+
+    struct JobSystemSpecification final {
+        static constexpr uint sAutoWorkers = UINT32_MAX;
+
+        JobScheduler scheduler      = JobScheduler::WorkStealing;
+        JobBackend   backend        = JobBackend::Threads;
+        uint         computeWorkers = sAutoWorkers; // Auto means one per core that is not reserved
+        uint         ioWorkers      = 0;
+        uint         reservedCores  = 0;     // The first cores are left to the main and render threads, compute workers are not pinned to them
+        bool         pinWorkers     = false; // One compute worker per core, using pthread_setaffinity_np / SetThreadAffinityMask
+        bool         numaAware      = false; // Hand out cores round robin across NUMA nodes, so workers spread over every node's memory
+    };
+
+#if defined( VAK_JOB_PROFILING )
+    // Counters accumulate from Init and are read without synchronization, so a snapshot can be slightly torn
+    struct JobWorkerStats final {
+        WorkerGroup group         = WorkerGroup::Compute;
+        ulong       jobsExecuted  = 0;
+        double      busyMs        = 0.0; // Running jobs, for fiber workers the time spent switched into fibers
+        double      idleMs        = 0.0; // The rest of the thread's lifetime, i.e. looking for work, polling and sleeping
+        ulong       stealAttempts = 0;
+        ulong       steals        = 0;
+        uint        queuedJobs[3] = {}; // Jobs sitting in the worker's deques, indexed High to Low
+    };
+
+    struct JobSystemStats final {
+        std::vector<JobWorkerStats> workers;           // Worker slots in order (slot 0 is the thread that called Init), then the I/O workers
+        JobWorkerStats              external;          // Every thread without a slot, lumped together
+        uint                        sharedQueued[3] = {}; // Shared FIFOs, indexed High to Low
+        uint                        ioQueued        = 0;
+    };
+#endif
+
     class JobSystem final : public Core::Singleton<JobSystem> {
     public:
-        void Init();
+        // The calling thread is registered as worker 0 and owns a deque, but only runs jobs when it waits on them
+        void Init( const JobSystemSpecification & );
+        void Init( JobScheduler = JobScheduler::WorkStealing, uint = std::thread::hardware_concurrency(), JobBackend = JobBackend::Threads );
         void Destroy();
 
-        void DispatchJob( Job, JobPriority = JobPriority::High );
+        JobHandle DispatchJob( Job, JobPriority = JobPriority::High );
+        JobHandle DispatchJob( Job, const JobSpecification & );
+
+        // Queues the job once ready( arg ) returns true. Pending polls are checked by threads that run out of queued jobs,
+        // so nothing blocks on the condition. arg has to stay alive until the job has been queued
+        void DispatchWhen( bool ( * )( const void * ), const void *, Job, JobPriority = JobPriority::High );
 
+        // Waits for a job and every job that was dispatched with it as a parent.
+        // Threads with a worker slot run queued jobs while they wait, unless helping was turned off
+        void WaitFor( JobHandle );
+        // Not allowed from inside a job, the job itself would never drop out of the count
         void WaitAll();
 
+        void SetHelpWhileWaiting( bool help ) { mHelpWhileWaiting = help; }
+
+        // Returns once done() holds. A job running on a fiber is suspended and polled by its worker in between other jobs,
+        // anywhere else the calling thread runs queued jobs while polling
+        template<typename Predicate> void WaitUntil( const Predicate & done ) {
+            if ( done() )
+                return;
+            if ( IsOnFiber() ) {
+                Suspend( []( const void * predicate ) { return static_cast<bool>( ( *static_cast<const Predicate *>( predicate ) )() ); }, &done );
+                return;
+            }
+            while ( !done() ) {
+                if ( !RunPendingJob() )
+                    std::this_thread::yield();
+            }
+        }
+
+        // True when the calling code runs inside a job on a fiber, i.e. WaitUntil parks instead of polling
+        bool IsOnFiber( void ) const;
+
+        bool IsComplete( JobHandle ) const;
+
+        // Steady clock in microseconds, the time base of JobSpecification::deadline
+        static ulong Now( void );
+
+        // Marks the start of a frame that has budgetMs for its jobs, FrameDeadline() is then its end
+        void BeginFrame( float budgetMs );
+        // End of the current frame, or of a later one. Falls back to the Normal aging delay before the first BeginFrame
+        ulong FrameDeadline( uint framesAhead = 0 ) const;
+
+        // Handle of the job running on the calling thread, used to parent jobs dispatched from inside a job
+        JobHandle CurrentJob( void ) const;
+
+        // Runs one queued job on the calling thread, returns false if there was nothing to run, the thread has no worker slot
+        // or it is already sMaxHelpDepth jobs deep in helping
+        bool RunPendingJob( void );
+
+        // Used by range splitting to decide whether there is demand for more parallelism
+        bool IsLocalQueueEmpty( void ) const;
+
+        // Slot of the calling thread in [0, GetWorkerSlotCount()), UINT32_MAX for threads the job system does not know
+        uint GetWorkerIndex( void ) const;
+        uint GetWorkerSlotCount( void ) const { return mWorkerQueueCount; }
+
+        JobScheduler GetScheduler( void ) const { return mScheduler; }
+        JobBackend   GetBackend( void ) const { return mBackend; }
+        uint         GetWorkerCount( void ) const { return static_cast<uint>( mThreadPool.size() ); }
+        uint         GetIoWorkerCount( void ) const { return static_cast<uint>( mIoThreadPool.size() ); }
+
+#if defined( VAK_JOB_PROFILING )
+        JobSystemStats GetStats( void );
+
+        // Records every job that runs from now on until EndTrace, which writes them as Chrome trace event JSON
+        // (chrome://tracing or ui.perfetto.dev). A job whose fiber got parked shows up as one event spanning the wait
+        void BeginTrace( void );
+        bool EndTrace( const std::filesystem::path & );
+#endif
+
     private:
-        std::vector<std::thread> mThreadPool;
+        static constexpr uint sPriorityCount   = 3;
+        static constexpr uint sDequeCapacity   = 4096;
+        static constexpr uint sSpinCount       = 64;
+        static constexpr auto sPollInterval    = std::chrono::microseconds( 100 ); // Nothing signals a poll turning ready, pollers sleep this long between checks
+        static constexpr uint sJobsPerWorker   = 1024;
+        static constexpr uint sMaxHelpDepth    = 8; // Bounds the stack growth of jobs waiting inside jobs they picked up while waiting
+        static constexpr uint sFibersPerWorker = 128; // Reserved up front and grown on demand, only the job nodes in flight bound it
+        static constexpr uint sFiberStackSize  = 1024 * 1024; // Texture compression runs inside jobs and is stack hungry
+
+        // Deadline scheduler, how far past its dispatch a job without an explicit deadline is due, indexed High to Low.
+        // Low jobs dispatched more than 100 ms ago run ahead of the current frame's jobs, which bounds how long streaming can starve
+        static constexpr ulong sAgingUs[3] = { 0, 16'000, 100'000 };
+
+        struct alignas( 64 ) JobNode final {
+            Job               job;
+            JobPriority       priority = JobPriority::High;
+            WorkerGroup       group    = WorkerGroup::Compute;
+            JobHandle         parent   = {};
+            ulong             deadline = 0;
+#if defined( VAK_JOB_PROFILING )
+            const char *      name     = nullptr;
+#endif
+
+            std::atomic<uint> unfinished   = 0; // The job itself plus its unfinished children
+            std::atomic<uint> dependencies = 0; // Unresolved dependencies, plus one held while dispatching
+            std::atomic<uint> gen          = 1;
+            std::atomic<uint> nextFree     = 0;
+            uint              arena        = 0;
+
+            // Guards finished and continuations, so late dependents either get registered or see the job as done
+            std::atomic_flag  lock;
+            bool              finished = false;
+            std::vector<uint> continuations;
+        };
+
+        // Nodes released by the owning thread go straight back on its free stack, nodes finished elsewhere are pushed on the
+        // remote list which the owner takes over in one exchange once its stack runs dry
+        struct NodeArena final {
+            uint                            freeNodes[sJobsPerWorker];
+            uint                            freeCount  = 0;
+            alignas( 64 ) std::atomic<uint> remoteFree = 0;
+            std::atomic_flag                lock; // Only taken for the arena shared by threads without a worker slot
+        };
+
+        struct WorkerQueues final {
+            Util::WorkStealingDeque<JobNode *, sDequeCapacity> queues[sPriorityCount]; // Indexed High to Low
+        };
+
+        // A fiber either runs a job, is parked in WaitUntil until ready( readyArg ) holds, or sits on the free list
+        struct FiberSlot final {
+            Fiber     fiber;
+            JobNode * job    = nullptr;
+            uint      worker = 0;
+
+            bool ( *ready )( const void * ) = nullptr;
+            const void * readyArg           = nullptr;
+        };
+
+        // Fibers never migrate, a parked fiber is resumed by the worker that parked it
+        struct WorkerFibers final {
+            Fiber                                   scheduler;
+            std::vector<std::unique_ptr<FiberSlot>> slots;
+            std::vector<FiberSlot *>                free;
+            std::vector<FiberSlot *>                parked;
+        };
+
+        JobScheduler mScheduler = JobScheduler::WorkStealing;
+        JobBackend   mBackend   = JobBackend::Threads;
+
+        std::unique_ptr<WorkerFibers[]> mWorkerFibers;
+
+        std::vector<std::thread>        mThreadPool;
+        std::unique_ptr<WorkerQueues[]> mWorkerQueues;
+        uint                            mWorkerQueueCount = 0;
+        std::vector<uint>               mWorkerCores; // Core each compute worker is pinned to, indexed by worker slot, empty when not pinning
+
+        // I/O workers block on the OS by design, so they get a plain locked FIFO and never take part in stealing
+        std::vector<std::thread> mIoThreadPool;
+        std::queue<JobNode *>    mIoQueue;
+        std::mutex               mIoQueueMutex;
+        std::condition_variable  mIoCondition;
 
+        // Global scheduler queues, also used by work stealing for threads that are not workers and when a deque overflows
         std::condition_variable mWaitCondition;
         std::mutex              mJobQueueMutex;
+        std::atomic<uint>       mSharedJobCount = 0;
 
-        std::atomic<uint> mJobCounter;
+        std::atomic<uint> mJobCounter = 0;
 
-        std::queue<Job> mLowQueue;
-        std::queue<Job> mNormalQueue;
-        std::queue<Job> mHighQueue;
+        std::queue<JobNode *> mLowQueue;
+        std::queue<JobNode *> mNormalQueue;
+        std::queue<JobNode *> mHighQueue;
 
-        bool mRunning;
+        // Deadline scheduler min-heap, also guarded by mJobQueueMutex. The sequence keeps jobs with equal deadlines in FIFO order
+        struct DeadlineEntry final {
+            ulong     deadline;
+            ulong     sequence;
+            JobNode * job;
 
-        void ThreadMainLoop();
+            bool operator >( const DeadlineEntry & other ) const { return deadline != other.deadline ? deadline > other.deadline : sequence > other.sequence; }
+        };
+        std::vector<DeadlineEntry> mDeadlineQueue;
+        ulong                      mDeadlineSequence = 0;
+        std::atomic<ulong>         mFrameStart       = 0;
+        std::atomic<ulong>         mFrameBudget      = 0;
+
+        // Job nodes live in one array split into an arena per worker slot, plus a last arena shared by threads without a slot
+        std::unique_ptr<JobNode[]>   mJobNodes;
+        std::unique_ptr<NodeArena[]> mNodeArenas;
+
+        // Idle work stealing workers park on the wake signal, dispatching bumps it and only notifies if someone is asleep
+        std::atomic<uint> mWakeSignal      = 0;
+        std::atomic<uint> mSleepingWorkers = 0;
+
+        struct PendingPoll final {
+            bool ( *ready )( const void * ) = nullptr;
+            const void * arg                = nullptr;
+            Job          job;
+            JobPriority  priority           = JobPriority::High;
+        };
+
+        // Only ever try-locked by pollers, so a dispatch made while polling cannot re-enter it
+        std::atomic_flag         mPollLock;
+        std::vector<PendingPoll> mPolls;
+        std::atomic<uint>        mPollCount = 0;
+        // Only one idle worker keeps checking the polls, the others park on the wake signal
+        std::atomic<bool>        mPolling   = false;
+
+        std::atomic<bool> mRunning         = false;
+        bool              mHelpWhileWaiting = true;
+
+#if defined( VAK_JOB_PROFILING )
+        struct TraceEvent final {
+            const char * name;
+            ulong        start; // Nanoseconds since mProfileEpoch
+            ulong        duration;
+        };
+
+        // Written by the owning thread only, apart from the last profile which every thread without a slot shares
+        struct alignas( 64 ) WorkerProfile final {
+            std::atomic<ulong>      jobs          = 0;
+            std::atomic<ulong>      busyNs        = 0;
+            std::atomic<ulong>      stealAttempts = 0;
+            std::atomic<ulong>      steals        = 0;
+            ulong                   startNs       = 0;
+            std::atomic_flag        lock; // Guards events against BeginTrace / EndTrace and the shared profile
+            std::vector<TraceEvent> events;
+        };
+
+        // Worker slots, then the I/O workers, then the shared profile
+        std::unique_ptr<WorkerProfile[]>      mProfiles;
+        uint                                  mProfileCount = 0;
+        std::chrono::steady_clock::time_point mProfileEpoch;
+        std::atomic<bool>                     mTracing = false;
+
+        ulong           ProfileNow( void ) const;
+        WorkerProfile & CurrentProfile( void );
+        void            RecordJob( const char *, ulong start, ulong end, bool countBusy );
+#endif
+
+        void ThreadMainLoop( uint );
+        void GlobalMainLoop( void );
+        void WorkStealingMainLoop( void );
+        void FiberMainLoop( uint );
+        void IoMainLoop( uint );
+
+        void RunFiber( WorkerFibers &, FiberSlot * );
+        void Suspend( bool ( * )( const void * ), const void * );
+        static void FiberMain( void * );
+
+        void      PushShared( JobNode * );
+        JobNode * PullShared( uint );
+        void      PushDeadline( JobNode * );
+        JobNode * PullDeadline( void );
+        JobNode * FindJob( void );
+        JobNode * NextJob( void );
+        bool      PollPending( void );
+        bool      ClaimPolling( bool & );
+        void      ReleasePolling( bool & );
+        void      Enqueue( JobNode * );
+        void      Execute( JobNode * );
+
+        template<typename Done> void HelpUntil( const Done & );
+
+        uint AllocateNode( void );
+        void ReleaseNode( uint );
+        void FinishNode( uint );
+        void ResolveDependency( uint );
+        bool AddContinuation( JobHandle, uint );
+        bool AddChild( JobHandle );
+
+        static constexpr uint PriorityIndex( JobPriority priority ) { return sPriorityCount - static_cast<uint>( priority ); }
+    };
+
+    // Lock that may be held across WaitUntil, contending jobs wait through WaitUntil as well instead of blocking their worker.
+    // A std::mutex held by a parked fiber would deadlock the next fiber on the same worker trying to take it
+    class JobMutex final {
+    public:
+        void lock( void ) {
+            while ( !try_lock() )
+                JobSystem::Instance()->WaitUntil( [this] { return !mLocked.test( std::memory_order_relaxed ); } );
+        }
+        bool try_lock( void ) { return !mLocked.test_and_set( std::memory_order_acquire ); }
+        void unlock( void ) { mLocked.clear( std::memory_order_release ); }
+
+    private:
+        std::atomic_flag mLocked;
     };
 
 }
@@ -0,0 +1,85 @@
+#pragma once
+#include <Util/Defines.hpp>
+#include <Core/JobSystem.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace Core {
+
+    namespace Detail {
+        // Lazy binary splitting, a range only splits in half when the local queue has run dry (i.e. someone stole our previous half),
+        // otherwise it keeps chewing through grain sized chunks. https://www.cs.cmu.edu/afs/cs/academic/class/15740-f18/www/papers/tzannes-ppopp10.pdf
+        template<typename Chunk> void SplitRange( uint begin, uint end, uint grainSize, const Chunk & chunk, std::atomic<uint> & pending ) {
+            JobSystem * js = JobSystem::Instance();
+            while ( end - begin > grainSize ) {
+                if ( js->IsLocalQueueEmpty() ) {
+                    const uint mid = begin + ( end - begin ) / 2;
+                    pending.fetch_add( 1, std::memory_order_relaxed );
+                    js->DispatchJob( [=, &chunk, &pending] {
+                        SplitRange( mid, end, grainSize, chunk, pending );
+                        pending.fetch_sub( 1, std::memory_order_release );
+                    }, { .name = "ParallelFor" } );
+                    end = mid;
+                } else {
+                    chunk( begin, begin + grainSize );
+                    begin += grainSize;
+                }
+            }
+            chunk( begin, end );
+        }
+
+        // The calling thread works on the range as well, and keeps running queued jobs while the stolen halves finish.
+        // This way a ParallelFor nested inside a job never parks a worker
+        template<typename Chunk> void ParallelRange( uint begin, uint end, uint grainSize, const Chunk & chunk ) {
+            if ( begin >= end )
+                return;
+            grainSize = std::max( grainSize, 1u );
+
+            std::atomic<uint> pending = 0;
+            SplitRange( begin, end, grainSize, chunk, pending );
+            while ( pending.load( std::memory_order_acquire ) != 0 ) {
+                if ( !JobSystem::Instance()->RunPendingJob() )
+                    std::this_thread::yield();
+            }
+        }
+    }
+
+    // Calls fn( i ) for every i in [begin, end), returns once all of them have run
+    template<typename Function> void ParallelFor( uint begin, uint end, uint grainSize, Function && fn ) {
+        Detail::ParallelRange( begin, end, grainSize, [&fn]( uint first, uint last ) {
+            for ( uint i = first; i < last; ++i )
+                fn( i );
+        });
+    }
+
+    // Folds map( i ) for every i in [begin, end) with reduce, which has to be associative and commutative since chunks are combined
+    // per worker in whatever order they finish
+    template<typename Type, typename Map, typename Reduce> Type ParallelReduce( uint begin, uint end, uint grainSize, Type identity, Map && map, Reduce && reduce ) {
+        struct alignas( 64 ) Partial final {
+            Type value;
+        };
+        JobSystem * js = JobSystem::Instance();
+
+        // One extra slot for a caller that is not a job system thread
+        const uint slots = js->GetWorkerSlotCount() + 1;
+        std::vector<Partial> partials( slots, Partial { identity } );
+
+        Detail::ParallelRange( begin, end, grainSize, [&]( uint first, uint last ) {
+            Type accumulated = identity;
+            for ( uint i = first; i < last; ++i )
+                accumulated = reduce( accumulated, map( i ) );
+
+            const uint worker = std::min( js->GetWorkerIndex(), slots - 1 );
+            partials[worker].value = reduce( partials[worker].value, accumulated );
+        });
+
+        Type result = identity;
+        for ( const Partial & partial : partials )
+            result = reduce( result, partial.value );
+        return result;
+    }
+
+}
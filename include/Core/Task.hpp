@@ -0,0 +1,178 @@
+#pragma once
+#include <Util/Defines.hpp>
+#include <Core/JobSystem.hpp>
+
+#include <coroutine>
+#include <atomic>
+#include <optional>
+#include <vector>
+#include <filesystem>
+#include <exception>
+#include <type_traits>
+#include <assert.h>
+
+namespace Core {
+
+    template<typename Type = void> class Task;
+
+    namespace Detail {
+        struct TaskPromiseBase {
+            // Null while running, the awaiting coroutine once somebody suspended on the task, &sDoneTag once it finished
+            std::atomic<void *> continuation = nullptr;
+            bool                started      = false;
+
+            static inline char sDoneTag = 0;
+
+            struct FinalAwaiter final {
+                bool await_ready( void ) const noexcept { return false; }
+                template<typename Promise> std::coroutine_handle<> await_suspend( std::coroutine_handle<Promise> handle ) const noexcept {
+                    void * awaiting = handle.promise().continuation.exchange( &sDoneTag, std::memory_order_acq_rel );
+                    return awaiting ? std::coroutine_handle<>::from_address( awaiting ) : std::noop_coroutine();
+                }
+                void await_resume( void ) const noexcept {}
+            };
+
+            std::suspend_always initial_suspend( void ) const noexcept { return {}; }
+            FinalAwaiter        final_suspend( void ) const noexcept { return {}; }
+            void                unhandled_exception( void ) const { std::terminate(); }
+
+            bool Done( void ) const { return continuation.load( std::memory_order_acquire ) == &sDoneTag; }
+        };
+
+        template<typename Type> struct TaskPromise final : TaskPromiseBase {
+            std::optional<Type> value;
+
+            Task<Type> get_return_object( void );
+            template<typename Value> void return_value( Value && result ) { value.emplace( std::forward<Value>( result ) ); }
+        };
+
+        template<> struct TaskPromise<void> final : TaskPromiseBase {
+            Task<void> get_return_object( void );
+            void return_void( void ) const {}
+        };
+    }
+
+    // Lazily started coroutine. Awaiting it runs it inline on the awaiting thread, Start() hands it to the job system instead.
+    // Whichever thread finishes the task resumes the coroutine awaiting it, so code after a co_await may continue on another worker
+    template<typename Type> class Task final {
+    public:
+        using promise_type = Detail::TaskPromise<Type>;
+
+        Task() = default;
+        explicit Task( std::coroutine_handle<promise_type> handle ) : mHandle( handle ) {}
+        Task( Task && other ) noexcept : mHandle( std::exchange( other.mHandle, nullptr ) ) {}
+        Task & operator =( Task && other ) noexcept {
+            if ( this != &other ) {
+                Release();
+                mHandle = std::exchange( other.mHandle, nullptr );
+            }
+            return *this;
+        }
+        Task( const Task & ) = delete;
+        Task & operator =( const Task & ) = delete;
+        ~Task() { Release(); }
+
+        bool Done( void ) const { return !mHandle || mHandle.promise().Done(); }
+
+        // Queues the task on a worker, it can still be awaited or waited on afterwards
+        void Start( JobPriority priority = JobPriority::High ) {
+            assert( mHandle && !mHandle.promise().started );
+            mHandle.promise().started = true;
+            JobSystem::Instance()->DispatchJob( [handle = mHandle] { handle.resume(); }, { .priority = priority, .name = "Task" } );
+        }
+
+        // For code that is not a coroutine itself, starts the task if needed and waits for it through JobSystem::WaitUntil
+        Type Wait( void ) {
+            if ( !mHandle.promise().started )
+                Start();
+            JobSystem::Instance()->WaitUntil( [this] { return Done(); } );
+            if constexpr ( !std::is_void_v<Type> )
+                return std::move( *mHandle.promise().value );
+        }
+
+        bool await_ready( void ) const { return mHandle.promise().started && Done(); }
+
+        std::coroutine_handle<> await_suspend( std::coroutine_handle<> awaiting ) {
+            promise_type & promise = mHandle.promise();
+            if ( !promise.started ) {
+                // Symmetric transfer into the task, it resumes us from its final suspend
+                promise.started = true;
+                promise.continuation.store( awaiting.address(), std::memory_order_relaxed );
+                return mHandle;
+            }
+
+            // Already running elsewhere, either we get registered or it finished in the meantime and we carry on
+            void * expected = nullptr;
+            if ( promise.continuation.compare_exchange_strong( expected, awaiting.address(), std::memory_order_acq_rel ) )
+                return std::noop_coroutine();
+            return awaiting;
+        }
+
+        Type await_resume( void ) {
+            if constexpr ( !std::is_void_v<Type> )
+                return std::move( *mHandle.promise().value );
+        }
+
+    private:
+        std::coroutine_handle<promise_type> mHandle;
+
+        void Release( void ) {
+            if ( !mHandle )
+                return;
+            // Destroying a frame that is still running would pull the stack out from under it
+            assert( !mHandle.promise().started || mHandle.promise().Done() );
+            mHandle.destroy();
+        }
+    };
+
+    template<typename Type> Task<Type> Detail::TaskPromise<Type>::get_return_object( void ) {
+        return Task<Type>( std::coroutine_handle<TaskPromise<Type>>::from_promise( *this ) );
+    }
+
+    inline Task<void> Detail::TaskPromise<void>::get_return_object( void ) {
+        return Task<void>( std::coroutine_handle<TaskPromise<void>>::from_promise( *this ) );
+    }
+
+    // co_await Schedule {} continues the coroutine as a job, e.g. to get off the thread that started it
+    struct Schedule final {
+        JobPriority  priority = JobPriority::High;
+        WorkerGroup  group    = WorkerGroup::Compute;
+        const char * name     = "Schedule";
+
+        bool await_ready( void ) const noexcept { return false; }
+        void await_suspend( std::coroutine_handle<> handle ) const {
+            JobSystem::Instance()->DispatchJob( [handle] { handle.resume(); }, { .priority = priority, .group = group, .name = name } );
+        }
+        void await_resume( void ) const noexcept {}
+    };
+
+    // Suspends until the predicate holds. It is polled by the job system between jobs, no thread blocks on it
+    template<typename Predicate> class WhenReady final {
+    public:
+        explicit WhenReady( Predicate ready, JobPriority priority = JobPriority::High ) : mReady( std::move( ready ) ), mPriority( priority ) {}
+
+        bool await_ready( void ) const { return mReady(); }
+        void await_suspend( std::coroutine_handle<> handle ) {
+            JobSystem::Instance()->DispatchWhen( &WhenReady::Poll, this, [handle] { handle.resume(); }, mPriority );
+        }
+        void await_resume( void ) const noexcept {}
+
+    private:
+        Predicate   mReady;
+        JobPriority mPriority;
+
+        static bool Poll( const void * self ) { return static_cast<const WhenReady *>( self )->mReady(); }
+    };
+
+    // Starts every task at once and completes when all of them have
+    inline Task<void> WhenAll( std::vector<Task<void>> tasks ) {
+        for ( Task<void> & task : tasks )
+            task.Start();
+        for ( Task<void> & task : tasks )
+            co_await task;
+    }
+
+    // Reads a whole file on an I/O worker, an empty result means the file could not be read
+    Task<std::vector<_byte>> ReadFileAsync( std::filesystem::path );
+
+}
@@ -19,6 +19,7 @@ namespace Core {
         void PollEvents( void );
 
         void SetWindowResolution( uint2 resolution ) { mWinResolution = resolution; }
+        void SetJobSystemSpecification( const JobSystemSpecification & spec ) { mJobSpec = spec; }
 
         HWND      GetWindowHandle( void ) const { return mWindowHandle; }
         HINSTANCE GetWindowInstance( void ) const { return mWinInstance; }
@@ -36,6 +37,8 @@ namespace Core {
         uint2     mWinResolution = { 1920, 1080 };
         bool      mShouldClose   = false;
 
+        JobSystemSpecification mJobSpec;
+
         LARGE_INTEGER mLastTime;
         float         mFrequency;
 
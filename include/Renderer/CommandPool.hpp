@@ -7,6 +7,11 @@
 
 #include <Resource/Resource.hpp>
 
+#include <span>
+#include <deque>
+#include <vector>
+#include <mutex>
+
 namespace Rhi {
     struct Buffer;
     struct RenderPipeline;
@@ -14,8 +19,11 @@ namespace Rhi {
     class CommandPool;
     class CommandList final {
     public:
-        void BeginRendering( Util::TextureHandle, Util::TextureHandle = {} );
+        // With VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT everything inside the pass comes from ExecuteCommands
+        void BeginRendering( Util::TextureHandle, Util::TextureHandle = {}, VkRenderingFlags = 0 );
         void EndRendering( void );
+        // Ends the secondary lists and executes them in the given order, their recording has to be finished
+        void ExecuteCommands( std::span<CommandList * const> );
 
         void Draw( uint vertexCount, uint instanceCount = 1, uint firstVertex = 0, uint firstInstance = 0 );
         void DrawIndexed( uint indexCount, uint instanceCount = 1, uint firstIndex = 0, uint vertexOffset = 0, uint firstInstance = 0 );
@@ -30,39 +38,75 @@ namespace Rhi {
         void Copy( Util::BufferHandle, VkImage, VkBufferImageCopy * );
 
         void BufferBarrier( Util::BufferHandle, VkPipelineStageFlags2, VkPipelineStageFlags2 );
-        void ImageBarrier( Texture *, VkImageLayout );
+        void ImageBarrier( Util::TextureHandle, VkImageLayout );
+
+        // Release half of a queue family ownership transfer away from this list's queue. The returned acquire half has to be
+        // recorded on the destination queue by AcquireOwnership, after a semaphore wait on the submit that released it
+        VkBufferMemoryBarrier2 ReleaseOwnership( Util::BufferHandle, QueueType, VkPipelineStageFlags2 );
+        VkImageMemoryBarrier2  ReleaseOwnership( Util::TextureHandle, QueueType, VkImageLayout );
+        void AcquireOwnership( std::span<const VkBufferMemoryBarrier2>, std::span<const VkImageMemoryBarrier2> );
 
         void PushConstants( const void *, uint );
 
         void BeginDebugLabel( const char *, const float (&)[4] );
         void EndDebugLabel( void );
 
+        VkCommandPool   mPool           = VK_NULL_HANDLE;
         VkCommandBuffer mBuf            = VK_NULL_HANDLE;
         VkFence         mFence          = VK_NULL_HANDLE;
         VkSemaphore     mSemaphore      = VK_NULL_HANDLE;
         const RenderPipeline * mBoundRP = nullptr;
         bool            mReady          = true;
+        QueueType       mQueue          = QueueType_Graphics;
+    };
+
+    // Timeline value a submit additionally signals or waits on, e.g. the staging device's upload batches
+    struct TimelinePoint {
+        VkSemaphore semaphore = VK_NULL_HANDLE;
+        ulong       value     = 0;
     };
 
+    // Primary lists each own a pool, so any thread may record one while others do the same. Secondary lists come from a pool per
+    // worker and frame in flight, which is reset as a whole once the frame that executed them has finished on the GPU
     class CommandPool final : public Core::Singleton<CommandPool> {
     public:
         void Init( void );
         void Destroy( void );
 
+        // Waits for the frame that last used this frame's secondary pools and resets them, call before recording the frame
+        void BeginFrame( void );
+
         CommandList * AcquireCommandList( void );
-        void Submit( CommandList *, Util::TextureHandle = {} );
+        // Recorded by the calling worker for a pass rendering into the given attachments. Recording must not wait on anything
+        // that could move the job to another thread, the list is bound to the worker's pool
+        CommandList * AcquireSecondaryCommandList( Util::TextureHandle, Util::TextureHandle = {} );
+        void Submit( CommandList *, Util::TextureHandle = {}, TimelinePoint signal = {}, TimelinePoint wait = {} );
 
-        void SetSwapchainAcquireSemaphore( VkSemaphore acquire ) { mSwapchainAcquireSemaphore = acquire; }
+        void SetSwapchainAcquireSemaphore( VkSemaphore );
 
         void WaitAll( void );
 
     private:
         static constexpr uint sMaxCommandLists = 16;
+        static constexpr uint sFramesInFlight  = 4;
+
+        // Deque so the lists handed out stay put while a worker allocates more
+        struct alignas( 64 ) WorkerPool final {
+            VkCommandPool           pool = VK_NULL_HANDLE;
+            std::deque<CommandList> lists;
+            uint                    used = 0;
+        };
+        struct FrameSlot final {
+            std::vector<WorkerPool> workers;
+            ulong                   value = 0; // Timeline value the frame's submit signals
+        };
 
-        VkCommandPool mCommandPool;
         CommandList   mCommandLists[sMaxCommandLists];
-
         uint          mCommandListCount = sMaxCommandLists;
+        std::mutex    mMutex; // Loading jobs acquire and submit lists for staging while the main thread records its frame
+
+        FrameSlot     mFrames[sFramesInFlight];
+        uint          mFrameSlot = 0;
 
         VkSemaphore mLastSubmitSemaphore       = VK_NULL_HANDLE;
         VkSemaphore mSwapchainAcquireSemaphore = VK_NULL_HANDLE;
@@ -4,6 +4,10 @@
 #include <Util/Pool.hpp>
 #include <Renderer/RenderBase.hpp>
 
+#include <atomic>
+#include <mutex>
+#include <vector>
+
 namespace Rhi {
 
     enum : _byte {
@@ -18,18 +22,24 @@ namespace Rhi {
         void Destroy( void );
 
         void SetUpdateDescriptors( void ) { mShouldUpdateDescriptors = true; }
+        // The slot is pointed back at the dummy on the next update, its old view is gone
+        void ReleaseTextureSlot( uint );
         void UpdateDescriptorSets( void );
 
         VkDescriptorSetLayout GetDescriptorSetLayout( void ) const { return mDescriptorLayout; }
         VkDescriptorSet       GetDescriptorSet( void ) const { return mDescriptorSet; }
 
+        // Sizes of the bindless arrays, the texture and sampler pools are capped to these since a slot index is the array index
+        static constexpr ushort sMaxTextures = 4096;
+        static constexpr ushort sMaxSamplers = 8;
+
     private:
         VkDescriptorPool      mDescriptorPool          = VK_NULL_HANDLE;
         VkDescriptorSet       mDescriptorSet           = VK_NULL_HANDLE;
         VkDescriptorSetLayout mDescriptorLayout        = VK_NULL_HANDLE;
-        bool                  mShouldUpdateDescriptors = true;
+        std::atomic<bool>     mShouldUpdateDescriptors = true; // Set by resource creation on loading jobs
 
-        static constexpr ushort sMaxTextures = 128;
-        static constexpr ushort sMaxSamplers = 8;
+        std::mutex            mReleasedMutex;
+        std::vector<uint>     mReleasedTextureSlots;
     };
 }
@@ -2,20 +2,22 @@
 #include <Util/Singleton.hpp>
 #include <Renderer/RenderBase.hpp>
 #include <Renderer/RenderContext.hpp>
+#include <Renderer/Descriptors.hpp>
+#include <Renderer/CommandPool.hpp>
 #include <Core/WindowManager.hpp>
+#include <Core/JobSystem.hpp>
+#include <Core/Task.hpp>
 #include <ktx.h>
 
 #include <vector>
+#include <deque>
+#include <variant>
 #include <algorithm>
 #include <mutex>
+#include <atomic>
 
 namespace Rhi {
 
-    enum QueueType : _byte {
-        QueueType_Graphics,
-        QueueType_Transfer
-    };
-
     struct DeviceQueues {
         VkQueue graphics = VK_NULL_HANDLE;
         VkQueue transfer = VK_NULL_HANDLE;
@@ -26,26 +28,129 @@ namespace Rhi {
         inline bool Valid( void ) const { return graphicsIndex != UINT32_MAX && transferIndex != UINT32_MAX; }
     };
 
+    // Signal value of the upload batch a copy went into, complete once graphics has taken ownership of what it uploaded
+    struct UploadToken {
+        ulong value = 0;
+    };
+
+    // Part of the staging ring handed out by Reserve, the producer fills ptr[0, size) and queues one copy out of it
+    struct StagingSlice {
+        _byte * ptr    = nullptr;
+        size_t  offset = 0;
+        size_t  size   = 0;
+    };
+
+    // The staging buffer is a ring of segments. Producers on any thread bump-allocate slices from the current segment with
+    // an atomic add, write their data straight into the mapped memory and queue a copy descriptor. Flush records every queued
+    // copy into one batch on the dedicated transfer queue, and once a batch has landed the next flush acquires its resources on
+    // graphics. A segment is reused when all of its slices were flushed and the batches reading them have finished
     class StagingDevice final : public Core::Singleton<StagingDevice> {
     public:
         void Init( void );
         void Destroy( void );
 
-        void Upload( Util::BufferHandle, const void *, size_t );
-        void Upload( Util::TextureHandle, const void * );
-        void Upload( Util::TextureHandle, ktxTexture2 * );
+        UploadToken Upload( Util::BufferHandle, const void *, size_t );
+        UploadToken Upload( Util::TextureHandle, const void * );
+        UploadToken Upload( Util::TextureHandle, ktxTexture2 * );
 
-    private:
-        Util::BufferHandle mStagingBuffer;
-        size_t             mStagingBufferSize     = 0;
-        size_t             mStagingBufferCapacity = 0;
-        size_t             mCurrentOffset         = 0;
+        // Lock free unless the ring has to move on to the next segment. Queue the slice before reserving another one, a producer
+        // holding on to an old slice keeps its segment from being reused
+        StagingSlice Reserve( size_t );
+        // Copies into one resource are recorded in the order they were queued, the one flagged last hands it over to graphics
+        UploadToken  Enqueue( const StagingSlice &, Util::BufferHandle, size_t, bool );
+        UploadToken  Enqueue( const StagingSlice &, Util::TextureHandle, const VkBufferImageCopy &, bool );
+        // Region of a tightly packed band of rows starting at the given row of a mip
+        static VkBufferImageCopy BandCopy( uint, VkExtent3D, uint, uint );
+
+        // Records and submits everything queued since the last flush and hands finished batches to graphics,
+        // the renderer calls it every frame before its own submit
+        UploadToken Flush( void );
+
+        bool IsComplete( UploadToken token ) const { return mAcquiredValue.load( std::memory_order_acquire ) >= token.value; }
+        // Flushes if the token's copies are still queued, a job on a fiber is parked instead of blocking its worker
+        void Wait( UploadToken );
+        // co_await Completed( token ) suspends a coroutine until the batch is usable on graphics, which takes a flush
+        auto Completed( UploadToken token ) const { return Core::WhenReady( [this, token] { return IsComplete( token ); } ); }
 
-        VkFence mStagingFence         = VK_NULL_HANDLE;
+        VkSemaphore  GetTimeline( void ) const { return mTimeline; }
+        StagingStats GetStats( void ) const;
 
+        // Largest slice Reserve hands out, bigger uploads are split into chunks of at most this size
+        static constexpr size_t sMaxSliceSize = 4 * 1024 * 1024;
+
+    private:
+        static constexpr uint   sSegmentCount = 8;
+        static constexpr size_t sSegmentSize  = 8 * 1024 * 1024;
+        // Covers the 16 byte texel blocks of BC formats and the 4 byte offset rule for everything else
+        static constexpr size_t sAlignment    = 16;
+        static constexpr uint   sMaxBatches   = 8;
+
+        // head only ever grows until the segment is recycled, a reservation that runs past the end marks it full
+        struct Segment {
+            std::atomic<size_t> head    = 0;
+            std::atomic<uint>   pending = 0; // Reserved slices whose copy has not been queued yet
+            ulong               value   = 0; // Last batch reading from it, guarded by mMutex
+        };
+
+        struct BufferCopy {
+            Util::BufferHandle handle;
+            VkBufferCopy       copy;
+        };
+        struct ImageCopy {
+            Util::TextureHandle handle;
+            VkBufferImageCopy   copy;
+        };
+        struct QueuedCopy {
+            std::variant<BufferCopy, ImageCopy> copy;
+            uint                                segment;
+            bool                                last;
+        };
+
+        // Acquire halves of the ownership transfers a batch released, recorded on graphics once the batch has landed
+        struct TransferBatch {
+            CommandList                    list;
+            ulong                          value = 0;
+            bool                           inUse = false;
+            vector<VkBufferMemoryBarrier2> bufferAcquires;
+            vector<VkImageMemoryBarrier2>  imageAcquires;
+        };
+
+        Util::BufferHandle mStagingBuffer;
+        _byte *            mStagingPtr = nullptr;
+        Segment            mSegments[sSegmentCount];
+        std::atomic<uint>  mCurrentSegment = 0;
+
+        // Producers only ever take this short lock, the submitted value moves under it too so tokens name the right batch
+        std::mutex          mQueueMutex;
+        vector<QueuedCopy>  mQueue;
+        std::atomic<ulong>  mSubmittedValue = 0;
+
+        VkCommandPool               mTransferPool = VK_NULL_HANDLE;
+        TransferBatch               mBatches[sMaxBatches];
+        std::deque<TransferBatch *> mPendingAcquire;
+
+        VkSemaphore        mTimeline      = VK_NULL_HANDLE;
+        std::atomic<ulong> mAcquiredValue = 0;
+
+        std::atomic<ulong> mBytesQueued = 0;
+        std::atomic<ulong> mStalls      = 0;
+        std::atomic<ulong> mStallUs     = 0;
+
+        // Taken by flushes and by producers moving the ring on, both may wait for the GPU while holding it
+        Core::JobMutex mMutex;
+
+        UploadToken     Enqueue( QueuedCopy &&, size_t );
+        void            AdvanceSegment( uint );
+        void            Record( TransferBatch *, const QueuedCopy & );
+        TransferBatch * AcquireBatch( void );
+        UploadToken     FlushLocked( void );
+        void            AcquireCompleted( void );
+        UploadToken     UploadMip( Util::TextureHandle, const _byte *, size_t, uint, VkExtent3D, uint, bool );
+        ulong           GetCounterValue( void ) const;
+        void            WaitForValue( ulong );
     };
 
-    using TexturePool = Util::Pool<Util::_Texture, Texture, TextureMetadata>;
+    using TexturePool = Util::Pool<Util::_Texture, Texture, TextureState, TextureMetadata>;
     using BufferPool  = Util::Pool<Util::_Buffer, Buffer, BufferMetadata>;
     using SamplerPool = Util::Pool<Util::_Sampler, Sampler, SamplerMetadata>;
 
@@ -83,12 +188,20 @@ namespace Rhi {
         Util::BufferHandle  CreateBuffer( const BufferSpecification & );
         Util::SamplerHandle CreateSampler( const SamplerSpecification & );
 
+        // Released resources are only queued, they get destroyed and their slots recycled once the GPU finished every frame
+        // in flight that could still reference them. Safe to call from any thread
         void Delete( Util::TextureHandle );
         void Delete( Util::BufferHandle );
         void Delete( Util::SamplerHandle );
 
+        // Destroys the queued resources whose frames reached the given timeline value, called once per frame
+        void CollectGarbage( ulong );
+
         ulong DeviceAddress( Util::BufferHandle );
 
+        // Whether images of this format can be written from the CPU through VK_EXT_host_image_copy without giving up optimal device access
+        bool SupportsHostImageCopy( VkFormat, VkImageUsageFlags ) const;
+
         VkImageView CreateImageView( VkImage, VkFormat, uint, VkImageAspectFlags );
 
         void QuerySurfaceCapabilities( void );
@@ -108,20 +221,39 @@ namespace Rhi {
         vector<VkFormat>           mDeviceDepthFormats;
         VkSurfaceCapabilitiesKHR   mSurfaceCapabilities;
 
-        TexturePool        mTexturePool { 128, "Texture" };
-        SamplerPool        mSamplerPool {  8, "Sampler" };
-        BufferPool         mBufferPool  { 64, "Buffer"  };
+        // VK_EXT_host_image_copy is enabled and can copy straight into SHADER_READ_ONLY_OPTIMAL
+        bool mHostImageCopy = false;
+
+        // Pools grow by one chunk of this many entries at a time, textures and buffers are created from loading jobs
+        TexturePool        mTexturePool { 256, "Texture", Descriptors::sMaxTextures, Util::PoolMode::Concurrent };
+        SamplerPool        mSamplerPool {   8, "Sampler", Descriptors::sMaxSamplers };
+        BufferPool         mBufferPool  { 256, "Buffer", UINT32_MAX, Util::PoolMode::Concurrent };
 
         // The dummy textures serves as a placeholder for the bindless array of textures that are not sampled (e.g. swapchain, depth etc),
         // in order to avoid a sparse array and problems with indices
         Util::TextureHandle mDummyTexture;
 
-        std::mutex mResourceCreationMutex;
+        // Release frame's timeline signal value paired with the handle, in release order so the front is always the oldest
+        struct PendingDelete {
+            ulong                                                                       timelineValue;
+            std::variant<Util::TextureHandle, Util::BufferHandle, Util::SamplerHandle> handle;
+        };
+        std::deque<PendingDelete> mPendingDeletes;
+        std::mutex                mPendingDeleteMutex;
+
+        void Release( PendingDelete && );
+        void Destroy( Util::TextureHandle );
+        void Destroy( Util::BufferHandle );
+        void Destroy( Util::SamplerHandle );
 
         void CreateSurface( void );
 
         void PickPhysicalDevice( VkPhysicalDeviceType );
         void CreateLogicalDevice( void );
+        bool QueryHostImageCopy( void ) const;
+
+        // Writes every mip from the ktx data on the calling thread, no command buffer or queue submission involved
+        void CopyToImageOnHost( Util::TextureHandle, ktxTexture2 * );
 
         uint FindQueueFamilyIndex( span<const VkQueueFamilyProperties>, VkQueueFlags, VkQueueFlags );
     };
@@ -21,6 +21,18 @@ namespace Rhi {
     using std::pair;
     using std::make_pair;
 
+    enum QueueType : _byte {
+        QueueType_Graphics,
+        QueueType_Transfer
+    };
+
+    // Running totals of the staging ring, the renderer turns them into per-frame numbers
+    struct StagingStats {
+        ulong bytesQueued = 0;
+        ulong stalls      = 0;
+        ulong stallUs     = 0;
+    };
+
     // @todo: Revisit this split of hot and cold data for every resource
 
     struct BufferSpecification final {
@@ -54,15 +66,20 @@ namespace Rhi {
         bool                  isSwapchain = false;
         std::string           debugName   = "You should name this texture!";
     };
+    // Textures are stored as three pool columns: the view data read by descriptor updates and attachments, the image and layout
+    // state that barriers read and write, and the metadata only needed when creating and destroying the image
     struct Texture final {
-        VkImage           image  = VK_NULL_HANDLE;
         VkImageView       view   = VK_NULL_HANDLE;
         VkExtent3D        extent = { 0, 0, 0 };
         VkImageType       type   = VK_IMAGE_TYPE_MAX_ENUM;
         VkFormat          format = VK_FORMAT_UNDEFINED;
-        VkImageLayout     layout = VK_IMAGE_LAYOUT_UNDEFINED;
         VkImageUsageFlags usage  = 0;
-        uint              mips   = 1;
+    };
+    struct TextureState final {
+        VkImage            image  = VK_NULL_HANDLE;
+        VkImageLayout      layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+        uint               mips   = 1;
     };
     struct TextureMetadata final {
         std::string    debugName   = "Texture: ";
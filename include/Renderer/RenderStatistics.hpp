@@ -1,6 +1,14 @@
 #pragma once
 #include <Util/Singleton.hpp>
 #include <Util/Defines.hpp>
+#include <Util/Pool.hpp>
+
+#include <vector>
+#include <atomic>
+
+#if defined( VAK_JOB_PROFILING )
+#include <Core/JobSystem.hpp>
+#endif
 
 namespace Rhi {
 
@@ -13,11 +21,19 @@ namespace Rhi {
         }
 
         float fps;
-        uint  cpuDrawCalls;
-        uint  indirectDrawCalls;
+        // Bumped by every list that records draws, which happens on several workers at once
+        std::atomic<uint> cpuDrawCalls;
+        std::atomic<uint> indirectDrawCalls;
         float vRamUsedGB;
         uint  totalVertices;
         uint2 renderResolution;
+        std::vector<Util::PoolStats> poolStats;
+        ulong uploadBytesPerFrame;
+        ulong uploadStalls;
+        float uploadStallMs;
+#if defined( VAK_JOB_PROFILING )
+        Core::JobSystemStats jobStats;
+#endif
 
     };
 
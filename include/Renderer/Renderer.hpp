@@ -3,6 +3,7 @@
 #include <Util/Containers.hpp>
 #include <Util/Pool.hpp>
 #include <Renderer/RenderBase.hpp>
+#include <Core/JobSystem.hpp>
 
 #include <Entity/Lights.hpp>
 
@@ -18,7 +19,7 @@ namespace Rhi {
 
     class Renderer final : public Core::Singleton<Renderer> {
     public:
-        void Init( uint2, void * );
+        void Init( uint2, void *, const Core::JobSystemSpecification & = {} );
         void Destroy( void );
 
         void Resize( uint2 );
@@ -48,6 +49,8 @@ namespace Rhi {
 
         Mesh mSponza, mCurtains;
 
+        StagingStats mLastStagingStats;
+
         void ComputeProjectionMatrix( void );
         void DebugPrintStructSizes( void );
 
@@ -2,6 +2,9 @@
 #include <Util/Defines.hpp>
 #include <Util/Singleton.hpp>
 #include <Renderer/RenderBase.hpp>
+#include <Core/Task.hpp>
+
+#include <atomic>
 
 namespace Rhi {
 
@@ -11,14 +14,21 @@ namespace Rhi {
         void Destroy( void );
 
         void SignalTimeline( ulong );
+        // Blocks until the timeline reaches the value, a job on a fiber is parked instead so its worker keeps going
+        void WaitForValue( ulong );
+        // co_await Reached( value ) suspends a coroutine until the timeline got there, the job system polls it in between jobs
+        auto Reached( ulong value ) const { return Core::WhenReady( [this, value] { return GetCounterValue() >= value; } ); }
+
+        ulong GetCounterValue( void ) const;
 
         VkSemaphore GetTimeline( void ) const { return mTimeline; }
-        ulong GetCurrentFrame( void ) const { return mFrame; }
+        // Read by loading jobs that release resources, only the main thread advances it
+        ulong GetCurrentFrame( void ) const { return mFrame.load( std::memory_order_acquire ); }
 
-        void IncrementFrame( void ) { mFrame++; }
+        void IncrementFrame( void ) { mFrame.fetch_add( 1, std::memory_order_release ); }
 
     private:
-        VkSemaphore mTimeline;
-        ulong       mFrame;
+        VkSemaphore        mTimeline;
+        std::atomic<ulong> mFrame = 0;
     };
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include <Util/Defines.hpp>
 #include <Util/Pool.hpp>
+#include <Core/Task.hpp>
 
 #include <utility>
 #include <fstream>
@@ -44,6 +45,11 @@ namespace Resource {
     ShaderFile LoadShader( const std::string & );
 
     ktxTexture2 * LoadTexture( const fs::path &, bool );
+    // Creates the texture and writes its levels straight into staging memory as they are decoded or read from the cache
+    Util::TextureHandle StreamTexture( const fs::path &, const std::string &, bool );
+    // Loads and uploads a texture wherever the task is started or awaited, writing its handle into the last argument once done,
+    // invalid if loading failed
+    Core::Task<void> LoadTextureAsync( fs::path, std::string, bool, Util::TextureHandle & );
 
     struct DrawParameters final {
         uint transformID;
@@ -58,6 +64,8 @@ namespace Resource {
         ~Mesh();
 
         bool LoadMeshFromFile( const fs::path &, bool, uint = 0 );
+        // Releases the buffers and textures of the mesh, they are destroyed after the frames in flight finished
+        void Unload( void );
 
         Util::BufferHandle mVertexBuffer;
         Util::BufferHandle mIndexBuffer;
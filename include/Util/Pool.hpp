@@ -2,12 +2,17 @@
 #include <Util/Defines.hpp>
 #include <assert.h>
 
-#include <stack>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdio>
+#include <mutex>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 
 namespace Util {
-    using std::stack;
-    using std::vector;
 
     // Generational Pools and Handles inspired by this presentation https://advances.realtimerendering.com/s2023/AaltonenHypeHypeAdvances2023.pdf
     // Some implementation details taken from https://github.com/corporateshark/lightweightvk/blob/master/lvk/Pool.h
@@ -23,7 +28,7 @@ namespace Util {
         bool operator !=( const Handle<Type> & other ) const { return mIndex != other.mIndex || mGen != other.mGen; }
 
     private:
-        template<typename Type, typename HotType, typename ColdType> friend class Pool;
+        template<typename, typename...> friend class Pool;
         Handle( uint idx, uint gen ) : mIndex( idx ), mGen( gen ) {}
 
         uint mIndex = 0;
@@ -39,116 +44,362 @@ namespace Util {
     using RenderPipelineHandle = Handle<struct _RenderPipeline>;
     using ModelHandle          = Handle<struct _Model>;
 
-    template<typename Type, typename HotType, typename ColdType> class Pool final {
+    enum class PoolMode : _byte {
+        SingleThreaded,
+        Concurrent      // Create, Delete and Get may be called from any thread, Clear still needs exclusive access
+    };
+
+    // Occupancy counters of one pool, cheap enough to stay on in release builds. Created is live + deleted
+    struct PoolStats final {
+        const char * name       = "";
+        uint         live       = 0;
+        uint         highWater  = 0; // Most entries alive at once since the pool was created
+        uint         capacity   = 0; // Slots allocated so far
+        uint         maxEntries = 0;
+        ulong        deleted    = 0; // Slots that went back to the free list
+    };
+
+    // Structure of arrays: every column lives in its own contiguous chunk arrays, next to one shared generation array, so a loop
+    // that needs a single column only pulls that column's cache lines. Columns are picked by type, e.g. Get<Metadata>( handle ).
+    // Storage grows in fixed size chunks that never move, so pointers from Get() and handles stay valid while the pool grows.
+    // maxEntries optionally caps the growth, Create returns an invalid handle once it is reached.
+    // Free slots form a Treiber stack whose head carries a tag that changes on every push and pop, so a stale head never wins
+    // a CAS (ABA). Single threaded pools walk the same list with plain loads and stores.
+    // Live handles are also kept in a dense array (sparse set), so ForEach visits only live entries and removal is a swap with the
+    // last one. Concurrent pools keep Create and Delete lock-free: they only flag the slot on a lock-free dirty list, which
+    // ForEach and GetHandles fold into the dense array under a lock of their own
+    template<typename Tag, typename... Columns> class Pool final {
+        static_assert( sizeof...( Columns ) > 0, "A pool needs at least one column" );
+
     private:
-        struct HotPoolEntry final {
-            explicit HotPoolEntry( HotType & obj ) : mObj( std::move( obj ) ) {}
-            explicit HotPoolEntry() : mObj( {} ), mGen( 1 ) {}
-            HotType mObj = {};
-            uint    mGen = 1;
-        };
-        struct ColdPoolEntry final {
-            explicit ColdPoolEntry( ColdType & obj ) : mObj( std::move( obj ) ) {}
-            explicit ColdPoolEntry() : mObj( {} ), mGen( 1 ) {}
-            ColdType mObj = {};
-            uint     mGen = 1;
+        static constexpr uint sInvalidIndex = UINT32_MAX;
+        static constexpr uint sMaxChunks    = 4096;
+
+        using FirstColumn = std::tuple_element_t<0, std::tuple<Columns...>>;
+
+        template<typename Column> static constexpr size_t ColumnIndex( void ) {
+            constexpr bool matches[] = { std::is_same_v<Column, Columns>... };
+            size_t index = sizeof...( Columns );
+            for ( size_t i = 0; i < sizeof...( Columns ); ++i ) {
+                if ( matches[i] ) {
+                    if ( index != sizeof...( Columns ) )
+                        return sizeof...( Columns ) + 1; // Ambiguous
+                    index = i;
+                }
+            }
+            return index;
+        }
+        template<typename Column> static constexpr bool sHasColumn = ColumnIndex<Column>() < sizeof...( Columns );
+
+        // Free list link and dense bookkeeping
+        struct SlotLink final {
+            std::atomic<uint> mNextFree   = sInvalidIndex;
+            uint              mDenseIndex = sInvalidIndex; // Position in mDense while the slot is in it
+            std::atomic<bool> mLive       = false;
+            std::atomic<bool> mDirty      = false;         // Queued on the dirty list, concurrent pools only
+            std::atomic<uint> mNextDirty  = sInvalidIndex;
         };
 
-        stack<uint>           mFreeList;
-        vector<HotPoolEntry>  mHotObjects;
-        vector<ColdPoolEntry> mColdObjects;
-        uint                  mEntries;
+        // The chunk tables are fixed size so that growing never moves them under a concurrent Get
+        template<typename Element> using ChunkTable = std::array<std::atomic<Element *>, sMaxChunks>;
+
+        std::tuple<ChunkTable<Columns>...> mColumns;
+        ChunkTable<std::atomic<uint>>      mGens;
+        ChunkTable<SlotLink>               mLinks;
+        std::atomic<uint>                  mChunkCount = 0;
+        std::mutex                         mGrowMutex;
+
+        alignas( 64 ) std::atomic<ulong> mFreeHead = sInvalidIndex; // Index in the low half, tag in the high half
+        alignas( 64 ) std::atomic<uint>  mEntries  = 0;
+        std::atomic<uint>                mHighWater = 0;
+        std::atomic<ulong>               mDeleted   = 0;
+
+        alignas( 64 ) std::atomic<uint> mDirtyHead = sInvalidIndex;
 
-        void Resize( uint newEntries ) {
-            assert( false && "TODO: Implement resizing resource pools!" );
+        std::vector<Handle<Tag>> mDense;
+        std::mutex               mDenseMutex; // Taken by ForEach and GetHandles only
+
+        uint         mChunkShift;
+        uint         mChunkMask;
+        uint         mMaxEntries;
+        PoolMode     mMode;
+        const char * mResourceType;
+
+        template<typename Element> Element & At( const ChunkTable<Element> & table, uint idx ) {
+            return table[idx >> mChunkShift].load( std::memory_order_relaxed )[idx & mChunkMask];
         }
+        template<typename Column> Column & Cell( uint idx ) {
+            return At( std::get<ColumnIndex<Column>()>( mColumns ), idx );
+        }
+        std::atomic<uint> & Gen( uint idx )  { return At( mGens, idx ); }
 
-    public:
-        explicit Pool( uint entries, const char * resourceType = "UNDEFINED" ) {
-            assert( entries > 0 && entries < UINT32_MAX );
-            mEntries = 0;
+        template<typename Element> Element * AllocateChunk( ChunkTable<Element> & table, uint chunk ) {
+            Element * entries = new Element[mChunkMask + 1];
+            table[chunk].store( entries, std::memory_order_relaxed );
+            return entries;
+        }
+        SlotLink &          Link( uint idx ) { return At( mLinks, idx ); }
 
-            mHotObjects.resize( entries );
-            mColdObjects.resize( entries );
+        static uint  HeadIndex( ulong head ) { return static_cast<uint>( head ); }
+        static ulong NextHead( ulong head, uint idx ) { return ( ( head >> 32 ) + 1 ) << 32 | idx; }
 
-            // Populate the free list so that the lowest indices are used first
-            for ( uint i = entries; i-- > 0; )
-                mFreeList.push( i );
-            printf("[INFO] Created %s Pool with %u entries!\n", resourceType, entries);
+        // Pushes the chain first..last, which is already linked through mNextFree
+        void PushFree( uint first, uint last ) {
+            ulong head = mFreeHead.load( std::memory_order_relaxed );
+            if ( mMode == PoolMode::SingleThreaded ) {
+                Link( last ).mNextFree.store( HeadIndex( head ), std::memory_order_relaxed );
+                mFreeHead.store( NextHead( head, first ), std::memory_order_relaxed );
+                return;
+            }
+            do {
+                Link( last ).mNextFree.store( HeadIndex( head ), std::memory_order_relaxed );
+            } while ( !mFreeHead.compare_exchange_weak( head, NextHead( head, first ), std::memory_order_release, std::memory_order_relaxed ) );
         }
 
-        [[nodiscard]] Handle<Type> Create( HotType && hot, ColdType && cold ) {
-            if ( mFreeList.empty() )
-                Resize( 0 );
+        void InsertDense( Handle<Tag> handle ) {
+            Link( handle.mIndex ).mDenseIndex = static_cast<uint>( mDense.size() );
+            mDense.push_back( handle );
+        }
 
-            const uint idx = mFreeList.top();
-            mFreeList.pop();
-            ++mEntries;
+        void RemoveDense( uint idx ) {
+            const uint pos = Link( idx ).mDenseIndex;
+            assert( pos < mDense.size() && mDense[pos].mIndex == idx );
+            mDense[pos] = mDense.back();
+            Link( mDense[pos].mIndex ).mDenseIndex = pos;
+            mDense.pop_back();
+            Link( idx ).mDenseIndex = sInvalidIndex;
+        }
 
-            const uint gen = mHotObjects[idx].mGen;
-            assert( gen == mColdObjects[idx].mGen );
+        // Only pushes happen concurrently, the drain takes the whole list at once, so the list has no ABA problem. A slot still
+        // queued is not pushed again, the drain reads its state after unflagging it
+        void MarkDirty( uint idx ) {
+            SlotLink & link = Link( idx );
+            if ( link.mDirty.exchange( true, std::memory_order_seq_cst ) )
+                return;
+            uint head = mDirtyHead.load( std::memory_order_relaxed );
+            do {
+                link.mNextDirty.store( head, std::memory_order_relaxed );
+            } while ( !mDirtyHead.compare_exchange_weak( head, idx, std::memory_order_release, std::memory_order_relaxed ) );
+        }
 
-            mHotObjects[idx].mObj = std::move( hot );
-            mColdObjects[idx].mObj = std::move( cold );
+        // Brings mDense up to date with every slot created or deleted since the last call, concurrent pools hold mDenseMutex.
+        // A slot deleted and created again in between gets its handle refreshed in place
+        void SyncDense( void ) {
+            uint idx = mDirtyHead.exchange( sInvalidIndex, std::memory_order_acquire );
+            while ( idx != sInvalidIndex ) {
+                SlotLink & link = Link( idx );
+                const uint next = link.mNextDirty.load( std::memory_order_relaxed );
+                link.mDirty.store( false, std::memory_order_seq_cst );
 
-            return Handle<Type>( idx, gen );
+                if ( link.mLive.load( std::memory_order_seq_cst ) ) {
+                    const Handle<Tag> handle( idx, Gen( idx ).load( std::memory_order_relaxed ) );
+                    if ( link.mDenseIndex == sInvalidIndex )
+                        InsertDense( handle );
+                    else
+                        mDense[link.mDenseIndex] = handle;
+                } else if ( link.mDenseIndex != sInvalidIndex ) {
+                    RemoveDense( idx );
+                }
+                idx = next;
+            }
         }
 
-        HotType * Get( Handle<Type> handle ) {
-            if ( !handle.Valid() )
-                return nullptr;
-            const uint idx = handle.mIndex;
-            assert( handle.mGen == mHotObjects[idx].mGen );
-            return &mHotObjects[idx].mObj;
+        std::unique_lock<std::mutex> LockDense( void ) {
+            std::unique_lock<std::mutex> lock( mDenseMutex, std::defer_lock );
+            if ( mMode == PoolMode::Concurrent ) {
+                lock.lock();
+                SyncDense();
+            }
+            return lock;
         }
 
-        ColdType * GetMetadata( Handle<Type> handle ) {
+        uint PopFree( void ) {
+            ulong head = mFreeHead.load( std::memory_order_acquire );
+            if ( mMode == PoolMode::SingleThreaded ) {
+                const uint idx = HeadIndex( head );
+                if ( idx != sInvalidIndex )
+                    mFreeHead.store( NextHead( head, Link( idx ).mNextFree.load( std::memory_order_relaxed ) ), std::memory_order_relaxed );
+                return idx;
+            }
+            // Reading mNextFree of a slot somebody else just popped is harmless, chunks are never freed and the tag makes the CAS fail
+            while ( HeadIndex( head ) != sInvalidIndex ) {
+                const uint next = Link( HeadIndex( head ) ).mNextFree.load( std::memory_order_relaxed );
+                if ( mFreeHead.compare_exchange_weak( head, NextHead( head, next ), std::memory_order_acquire, std::memory_order_acquire ) )
+                    return HeadIndex( head );
+            }
+            return sInvalidIndex;
+        }
+
+        // Appends one chunk to every column and pushes its slots, returns false once maxEntries is reached. Slots of the last chunk
+        // past maxEntries are never handed out. Concurrent pools grow under a mutex, threads that lost the race find the new slots
+        // on the free list
+        bool Grow( void ) {
+            std::unique_lock<std::mutex> lock( mGrowMutex, std::defer_lock );
+            if ( mMode == PoolMode::Concurrent ) {
+                lock.lock();
+                if ( HeadIndex( mFreeHead.load( std::memory_order_acquire ) ) != sInvalidIndex )
+                    return true;
+            }
+
+            const uint chunk        = mChunkCount.load( std::memory_order_relaxed );
+            const uint chunkEntries = mChunkMask + 1;
+            const uint first        = chunk << mChunkShift;
+            if ( first >= mMaxEntries )
+                return false;
+            const uint count = std::min( chunkEntries, mMaxEntries - first );
+
+            std::apply( [&]( auto &... tables ) { ( AllocateChunk( tables, chunk ), ... ); }, mColumns );
+            std::atomic<uint> * gens  = AllocateChunk( mGens, chunk );
+            SlotLink *          links = AllocateChunk( mLinks, chunk );
+            for ( uint i = 0; i < chunkEntries; ++i )
+                gens[i].store( 1, std::memory_order_relaxed );
+            for ( uint i = 0; i + 1 < count; ++i )
+                links[i].mNextFree.store( first + i + 1, std::memory_order_relaxed );
+            mChunkCount.store( chunk + 1, std::memory_order_release );
+
+            // Lowest indices end up on top, so they are used first
+            PushFree( first, first + count - 1 );
+            return true;
+        }
+
+        void FreeChunks( void ) {
+            const uint chunks = mChunkCount.load( std::memory_order_acquire );
+            for ( uint i = 0; i < chunks; ++i ) {
+                std::apply( [i]( auto &... tables ) { ( delete[] tables[i].exchange( nullptr, std::memory_order_relaxed ), ... ); }, mColumns );
+                delete[] mGens[i].exchange( nullptr, std::memory_order_relaxed );
+                delete[] mLinks[i].exchange( nullptr, std::memory_order_relaxed );
+            }
+            mChunkCount.store( 0, std::memory_order_relaxed );
+            mFreeHead.store( sInvalidIndex, std::memory_order_relaxed );
+            mEntries.store( 0, std::memory_order_relaxed );
+            mDirtyHead.store( sInvalidIndex, std::memory_order_relaxed );
+            mDense.clear();
+        }
+
+    public:
+        explicit Pool( uint chunkEntries, const char * resourceType = "UNDEFINED", uint maxEntries = UINT32_MAX, PoolMode mode = PoolMode::SingleThreaded ) {
+            assert( chunkEntries > 0 && chunkEntries <= ( 1u << 31 ) );
+            chunkEntries  = std::bit_ceil( chunkEntries );
+            mChunkShift   = static_cast<uint>( std::countr_zero( chunkEntries ) );
+            mChunkMask    = chunkEntries - 1;
+            mMaxEntries   = static_cast<uint>( std::min<ulong>( { maxEntries, static_cast<ulong>( sMaxChunks ) << mChunkShift, sInvalidIndex - 1 } ) );
+            mMode         = mode;
+            mResourceType = resourceType;
+
+            Grow();
+            printf( "[INFO] Created %s Pool with chunks of %u entries%s!\n", resourceType, chunkEntries, mode == PoolMode::Concurrent ? " (concurrent)" : "" );
+        }
+        Pool( const Pool & ) = delete;
+        Pool & operator =( const Pool & ) = delete;
+        ~Pool() { FreeChunks(); }
+
+        // Takes one value per column, in column order
+        [[nodiscard]] Handle<Tag> Create( Columns &&... values ) {
+            uint idx;
+            while ( ( idx = PopFree() ) == sInvalidIndex ) {
+                if ( !Grow() ) {
+                    // Callers check Valid() and clean up what they created for this entry
+                    printf( "[ERROR] %s Pool is full, %u entries!\n", mResourceType, mEntries.load( std::memory_order_relaxed ) );
+                    return {};
+                }
+            }
+            const uint live = mEntries.fetch_add( 1, std::memory_order_relaxed ) + 1;
+            uint peak = mHighWater.load( std::memory_order_relaxed );
+            while ( live > peak && !mHighWater.compare_exchange_weak( peak, live, std::memory_order_relaxed ) ) {}
+
+            ( ( Cell<Columns>( idx ) = std::move( values ) ), ... );
+
+            const Handle<Tag> handle( idx, Gen( idx ).load( std::memory_order_relaxed ) );
+            Link( idx ).mLive.store( true, std::memory_order_seq_cst );
+            if ( mMode == PoolMode::Concurrent )
+                MarkDirty( idx );
+            else
+                InsertDense( handle );
+            return handle;
+        }
+
+        template<typename Column> Column * Get( Handle<Tag> handle ) {
+            static_assert( sHasColumn<Column>, "Not a column of this pool, or listed more than once" );
             if ( !handle.Valid() )
                 return nullptr;
-            const uint idx = handle.mIndex;
-            assert( handle.mGen == mColdObjects[idx].mGen );
-            return &mColdObjects[idx].mObj;
+            assert( handle.mGen == Gen( handle.mIndex ).load( std::memory_order_relaxed ) );
+            return &Cell<Column>( handle.mIndex );
+        }
+        // The first column is what most callers are after
+        FirstColumn * Get( Handle<Tag> handle ) { return Get<FirstColumn>( handle ); }
+
+        // True while the entry the handle was created for has not been deleted
+        bool IsAlive( Handle<Tag> handle ) {
+            return handle.Valid() && handle.mIndex < GetObjectCount() && Gen( handle.mIndex ).load( std::memory_order_relaxed ) == handle.mGen;
         }
 
-        Handle<Type> GetHandle( uint index ) {
-            assert( mHotObjects.size() == mColdObjects.size() );
-            if ( index >= mHotObjects.size() )
+        Handle<Tag> GetHandle( uint index ) {
+            if ( index >= GetObjectCount() )
                 return {};
-            assert( mHotObjects[index].mGen == mColdObjects[index].mGen );
-            return Handle<Type>( index, mHotObjects[index].mGen );
+            return Handle<Tag>( index, Gen( index ).load( std::memory_order_relaxed ) );
         }
 
-        void Delete( Handle<Type> handle ) {
+        void Delete( Handle<Tag> handle ) {
             if ( !handle.Valid() )
                 return;
             const uint idx = handle.mIndex;
+            assert( handle.mGen == Gen( idx ).load( std::memory_order_relaxed ) );
 
-            assert( handle.mGen == mHotObjects[idx].mGen );
-            assert( handle.mGen == mColdObjects[idx].mGen );
+            // Unflagged first, so ForEach skips an entry that is being torn down
+            Link( idx ).mLive.store( false, std::memory_order_seq_cst );
+            if ( mMode == PoolMode::Concurrent )
+                MarkDirty( idx );
+            else
+                RemoveDense( idx );
 
-            mHotObjects[idx].mObj = HotType{};
-            mHotObjects[idx].mGen++;
+            ( ( Cell<Columns>( idx ) = Columns{} ), ... );
+            Gen( idx ).fetch_add( 1, std::memory_order_relaxed );
 
-            mColdObjects[idx].mObj = ColdType{};
-            mColdObjects[idx].mGen++;
+            mEntries.fetch_sub( 1, std::memory_order_relaxed );
+            mDeleted.fetch_add( 1, std::memory_order_relaxed );
+            PushFree( idx, idx );
+        }
 
-            mFreeList.push( idx );
-            --mEntries;
+        // Calls fn( handle, Selected &... ) for every live entry, in no particular order, touching only the selected columns.
+        // Entries created by other threads meanwhile may or may not be visited, deleting an entry while fn could be reading it
+        // is up to the caller to avoid. fn must not create or delete entries of this pool, use GetHandles() for that
+        template<typename... Selected, typename Function> void ForEach( Function && fn ) {
+            static_assert( ( sHasColumn<Selected> && ... ), "Not a column of this pool, or listed more than once" );
+            std::unique_lock<std::mutex> lock = LockDense();
+            for ( const Handle<Tag> handle : mDense ) {
+                // Concurrent pools may have deleted or reused the slot since the dense array was synced
+                if ( mMode == PoolMode::Concurrent && ( !Link( handle.mIndex ).mLive.load( std::memory_order_acquire ) ||
+                                                        Gen( handle.mIndex ).load( std::memory_order_relaxed ) != handle.mGen ) )
+                    continue;
+                fn( handle, Cell<Selected>( handle.mIndex )... );
+            }
         }
 
-        void Clear( void ) {
-            mHotObjects.clear();
-            mColdObjects.clear();
-            while ( !mFreeList.empty() )
-                mFreeList.pop();
-            mEntries = 0;
+        // Snapshot of the live handles
+        std::vector<Handle<Tag>> GetHandles( void ) {
+            std::unique_lock<std::mutex> lock = LockDense();
+            return mDense;
         }
 
-        uint GetEntryCount( void ) const { return mEntries; }
+        // Frees every chunk, the pool starts over from an empty first chunk on the next Create
+        void Clear( void ) { FreeChunks(); }
+
+        uint GetEntryCount( void ) const { return mEntries.load( std::memory_order_relaxed ); }
         size_t GetObjectCount( void ) const {
-            assert( mHotObjects.size() == mColdObjects.size() );
-            return mHotObjects.size();
+            return std::min<size_t>( static_cast<size_t>( mChunkCount.load( std::memory_order_acquire ) ) << mChunkShift, mMaxEntries );
         }
-        
+        uint GetMaxEntries( void ) const { return mMaxEntries; }
+
+        PoolStats GetStats( void ) const {
+            return PoolStats {
+                .name       = mResourceType,
+                .live       = mEntries.load( std::memory_order_relaxed ),
+                .highWater  = mHighWater.load( std::memory_order_relaxed ),
+                .capacity   = static_cast<uint>( GetObjectCount() ),
+                .maxEntries = mMaxEntries,
+                .deleted    = mDeleted.load( std::memory_order_relaxed )
+            };
+        }
+
     };
 }
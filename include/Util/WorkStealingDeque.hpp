@@ -0,0 +1,88 @@
+#pragma once
+#include <Util/Defines.hpp>
+
+#include <atomic>
+#include <type_traits>
+
+namespace Util {
+
+    // Fixed capacity Chase-Lev work-stealing deque, memory orderings follow "Correct and Efficient Work-Stealing for Weak Memory Models"
+    // https://fzn.fr/readings/ppopp13.pdf
+    // Only the owning thread may Push/Pop (LIFO end), any thread may Steal (FIFO end)
+    template<typename Type, uint Capacity> class WorkStealingDeque final {
+        static_assert( ( Capacity & ( Capacity - 1 ) ) == 0, "Capacity must be a power of two!" );
+        static_assert( std::is_trivially_copyable_v<Type> );
+
+    public:
+        WorkStealingDeque() = default;
+        WorkStealingDeque( const WorkStealingDeque & ) = delete;
+        WorkStealingDeque & operator =( const WorkStealingDeque & ) = delete;
+
+        // Returns false when the deque is full, the caller is expected to fall back to another queue
+        bool Push( Type item ) {
+            const slong bottom = mBottom.load( std::memory_order_relaxed );
+            const slong top    = mTop.load( std::memory_order_acquire );
+            if ( bottom - top >= static_cast<slong>( Capacity ) )
+                return false;
+
+            mItems[bottom & sMask].store( item, std::memory_order_relaxed );
+            mBottom.store( bottom + 1, std::memory_order_release );
+            return true;
+        }
+
+        bool Pop( Type & out ) {
+            const slong bottom = mBottom.load( std::memory_order_relaxed ) - 1;
+            mBottom.store( bottom, std::memory_order_relaxed );
+            std::atomic_thread_fence( std::memory_order_seq_cst );
+            slong top = mTop.load( std::memory_order_relaxed );
+
+            if ( top > bottom ) {
+                mBottom.store( bottom + 1, std::memory_order_relaxed );
+                return false;
+            }
+
+            out = mItems[bottom & sMask].load( std::memory_order_relaxed );
+            if ( top == bottom ) {
+                // Last item, race against thieves for it
+                const bool won = mTop.compare_exchange_strong( top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed );
+                mBottom.store( bottom + 1, std::memory_order_relaxed );
+                return won;
+            }
+            return true;
+        }
+
+        bool Steal( Type & out ) {
+            slong top = mTop.load( std::memory_order_acquire );
+            std::atomic_thread_fence( std::memory_order_seq_cst );
+            const slong bottom = mBottom.load( std::memory_order_acquire );
+
+            if ( top >= bottom )
+                return false;
+
+            Type item = mItems[top & sMask].load( std::memory_order_relaxed );
+            if ( !mTop.compare_exchange_strong( top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed ) )
+                return false;
+            out = item;
+            return true;
+        }
+
+        // Approximate when called concurrently, only meant for heuristics
+        bool Empty( void ) const {
+            return mBottom.load( std::memory_order_relaxed ) <= mTop.load( std::memory_order_relaxed );
+        }
+
+        // Approximate as well, used for statistics
+        uint Size( void ) const {
+            const slong size = mBottom.load( std::memory_order_relaxed ) - mTop.load( std::memory_order_relaxed );
+            return size > 0 ? static_cast<uint>( size ) : 0;
+        }
+
+    private:
+        static constexpr slong sMask = static_cast<slong>( Capacity ) - 1;
+
+        alignas( 64 ) std::atomic<slong> mTop    = 0;
+        alignas( 64 ) std::atomic<slong> mBottom = 0;
+        alignas( 64 ) std::atomic<Type>  mItems[Capacity];
+    };
+
+}